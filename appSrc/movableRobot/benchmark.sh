@@ -0,0 +1,42 @@
+#!/bin/bash
+#
+# Headless benchmark of the movableRobot block code.
+# Runs every world (*.xml) of a directory to completion without the viewer and appends
+# one JSON report per world (makespan, messages by type, motions, rounds, wall clock, heap per module).
+# The loading time of each world (startupMs) is printed before its report.
+#
+# usage: benchmark.sh <movableRobot binary> <worlds directory> [report file] [block code options...]
+#   VSIM_FLAGS overrides the simulator flags (default: terminal mode, fastest, exit at the end)
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <movableRobot binary> <worlds directory> [report file] [block code options...]"
+    exit 1
+fi
+
+EXEC=$(realpath "$1")
+WORLDS=$2
+REPORT=$(realpath -m "${3:-benchmark.jsonl}")
+shift 3 2>/dev/null || shift $#
+FLAGS=${VSIM_FLAGS:-"-t -R -x"}
+
+if [ ! -x "$EXEC" ]; then
+    echo "$EXEC not found, run make first"
+    exit 1
+fi
+
+status=0
+cd "$WORLDS" || exit 1
+for world in *.xml; do
+    printf "%-28s" "$world"
+    if "$EXEC" -c "$world" $FLAGS --report "$REPORT" "$@" > /dev/null 2>&1; then
+        # loading of the world apart from the reconfiguration
+        line=$(tail -n 1 "$REPORT")
+        startup=$(echo "$line" | grep -o '"startupMs":[^,}]*' | cut -d: -f2)
+        printf "startup %10s ms  %s\n" "$startup" "$line"
+    else
+        echo "FAILED"
+        status=1
+    fi
+done
+
+exit $status
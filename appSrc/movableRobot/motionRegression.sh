@@ -0,0 +1,84 @@
+#!/bin/bash
+#
+# Regression check of the motions of the movableRobot block code.
+# Runs every world (*.xml) of a directory headless with --verify-motions against its reference
+# <world>.motions: a run fails when its final shape differs from the reference or when it needs
+# more motions, when it does not end within MOTION_TIMEOUT seconds or when the reference is missing.
+#
+# usage: motionRegression.sh <movableRobot binary> <worlds directory> [block code options...]
+#   VSIM_FLAGS overrides the simulator flags (default: terminal mode, fastest, exit at the end)
+#   MOTION_SHAPE=1 only compares the final shape (--verify-shape), for the modes which elect
+#   the movers in another order than the references (--incremental)
+#   MOTION_COMPLETE=1 only checks that the reconfiguration completes ("completed" of --report), for
+#   the worlds without reference (generated by movableRobotWorldGen)
+#   MOTION_RECORD=1 records (--record-motions) the references from the current build instead
+#   MOTION_SKIP lists the worlds that are not run (default: cylinder2block_hole.xml, whose hole
+#   the block code never fills, the run does not end)
+#   MOTION_SEEDS lists the timing seeds each world is run with (default: 1), with a random latency
+#   drawn by the block code (--jitter normal) they give concurrent movers other interleavings
+#   the timing seeds are fixed so that the runs are reproducible
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <movableRobot binary> <worlds directory> [block code options...]"
+    exit 1
+fi
+
+EXEC=$(realpath "$1")
+WORLDS=$2
+shift 2
+FLAGS=${VSIM_FLAGS:-"-t -R -x"}
+TIMEOUT=${MOTION_TIMEOUT:-600}
+SKIP=${MOTION_SKIP-"cylinder2block_hole.xml"}
+SEEDS=${MOTION_SEEDS:-1}
+VERIFY=--verify-motions
+[ -n "$MOTION_SHAPE" ] && VERIFY=--verify-shape
+
+if [ ! -x "$EXEC" ]; then
+    echo "$EXEC not found, run make first"
+    exit 1
+fi
+
+status=0
+cd "$WORLDS" || exit 1
+for world in *.xml; do
+    reference="${world%.xml}.motions"
+    for seed in $SEEDS; do
+        if [ "$SEEDS" == "1" ]; then
+            printf "%-28s" "$world"
+        else
+            printf "%-28s" "$world $seed"
+        fi
+        if [[ " $SKIP " == *" $world "* ]]; then
+            echo "skipped"
+        elif [ -n "$MOTION_COMPLETE" ]; then
+            report=$(mktemp)
+            if timeout "$TIMEOUT" "$EXEC" -c "$world" $FLAGS --timing-seed $seed --report "$report" "$@" > /dev/null 2>&1 \
+               && grep -q '"completed":true' "$report"; then
+                echo "ok"
+            else
+                echo "FAILED"
+                status=1
+            fi
+            rm -f "$report"
+        elif [ -n "$MOTION_RECORD" ]; then
+            if timeout "$TIMEOUT" "$EXEC" -c "$world" $FLAGS --timing-seed $seed --record-motions "$reference" "$@" > /dev/null 2>&1; then
+                echo "recorded $(grep -c '^motion' "$reference") motions"
+            else
+                echo "FAILED"
+                status=1
+            fi
+        elif [ ! -f "$reference" ]; then
+            echo "FAILED"
+            echo "no reference $reference, record it with MOTION_RECORD=1"
+            status=1
+        elif log=$(timeout "$TIMEOUT" "$EXEC" -c "$world" $FLAGS --timing-seed $seed $VERIFY "$reference" "$@" 2>&1 > /dev/null); then
+            echo "ok"
+        else
+            echo "FAILED"
+            echo "$log" | tail -n 5
+            status=1
+        fi
+    done
+done
+
+exit $status
@@ -1,19 +1,48 @@
 #include <iostream>
+#include <chrono>
+#include <vector>
 
 #include "robots/hexanodes/hexanodesSimulator.h"
 #include "robots/hexanodes/hexanodesBlockCode.h"
 
 #include "movableRobotBlockCode.hpp"
+#include "movableRobotStats.hpp"
 
 using namespace std;
 using namespace Hexanodes;
 
 int main(int argc, char **argv) {
+    auto start = chrono::steady_clock::now();
+    MovableRobotStats::startTime = start;
+    MovableRobotStats::heapAtStart = MovableRobotStats::heapInUse();
+
+    int status = 0;
     try
     {
-        createSimulator(argc, argv, MovableRobotBlockCode::buildNewBlockCode);
+        // options are parsed by the command line of the simulator, those of the block code included,
+        // the configuration and the snapshot to resume from are needed before the simulator is created
+        CommandLine options(argc, argv, MovableRobotBlockCode::buildNewBlockCode);
+        string config = options.getConfigFile();
+
+        // a resumed run starts from the configuration written from the snapshot, the last -c is used
+        vector<char*> args(argv, argv + argc);
+        if (!MovableRobotBlockCode::resumeFile.empty()) {
+            if (!MovableRobotBlockCode::resume(MovableRobotBlockCode::resumeFile, config)) return 1;
+            args.push_back((char*)"-c");
+            args.push_back((char*)config.c_str());
+        }
+        args.push_back(nullptr);
+
+        createSimulator(args.size() - 1, args.data(), MovableRobotBlockCode::buildNewBlockCode);
         getSimulator()->printInfo();
         BaseSimulator::getWorld()->printInfo();
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        if (!MovableRobotBlockCode::checkMotions()) status = 1;
+        // status 2: the parameters do not apply to this world, the sweep skips the run
+        if (MovableRobotBlockCode::invalidParameters()) status = 2;
+        MovableRobotBlockCode::exportMetrics(true);
+        MovableRobotBlockCode::writeReport(config, elapsed.count());
+        MovableRobotTrace::close();
         deleteSimulator();
     }
     catch(std::exception const& e)
@@ -21,5 +50,5 @@ int main(int argc, char **argv) {
         cerr << "Uncaught exception: " << e.what();
     }
 
-    return 0;
+    return status;
 }
@@ -27,11 +27,14 @@
 
 
 #include "movableRobotBlockCode.hpp"
+#include "movableRobotStats.hpp"
 #include "robots/hexanodes/hexanodesWorld.h"
 
 //for delay
 #include <chrono>
 #include <thread>
+#include <fstream>
+#include <cstdio>
 
 #include <unistd.h>
 #include "events/scheduler.h"
@@ -42,54 +45,76 @@
 
 using namespace Hexanodes;
 
-MovableRobotBlockCode::MovableRobotBlockCode(HexanodesBlock *host) : HexanodesBlockCode(host) {
+MovableRobotBlockCode::MovableRobotBlockCode(HexanodesBlock *host) : HexanodesBlockCode(host),
+    isLeader(false), inPosition(false), moving(false), treeRoot(false), incrementalSettle(false),
+    awaitingSettle(false), dispatchWaiting(false), waveOpen(false), blocked(false), held(false), rewaveOnAck(false), acquiring(false), stepping(false),
+    lockSupported(false), lockKept(false), lockReserved(false), noMotion(false), gaveWay(false), wakePending(false), quietRound(false), walkValid(false), walkFound(false),
+    holdMotion(false), regionWaiting(false), wakeOnChange(false) {
     // @warning Do not remove block below, as a blockcode with a NULL host might be created
     //  for command line parsing
     if (not host) return;
-
-     addMessageEventFunc2(BROADCAST_MSG_ID,
-                       std::bind(&MovableRobotBlockCode::myBroadcastFunc,this,
-                       std::placeholders::_1, std::placeholders::_2));
-
-    // Registers a callback (myAcknowledgeFunc) to the message of type K
-    addMessageEventFunc2(ACKNOWLEDGE_MSG_ID,
-                       std::bind(&MovableRobotBlockCode::myAcknowledgeFunc,this,
-                       std::placeholders::_1, std::placeholders::_2));
-    addMessageEventFunc2(NEXT_MSG_ID,
-                       std::bind(&MovableRobotBlockCode::acknowledgeNextFunc,this,
-                       std::placeholders::_1, std::placeholders::_2));
-    addMessageEventFunc2(LEADER_FOUND_MSG_ID,
-                       std::bind(&MovableRobotBlockCode::NewLeader,this,
-                       std::placeholders::_1, std::placeholders::_2));
-
-    scheduler = getScheduler();
-    node = (HexanodesBlock*)hostBlock;
+    // the handlers are registered by startup(), once the mode of the run is known (regions come from the world)
   }
 
 // Function called by the module upon initialization
 void MovableRobotBlockCode::startup() {
+    bool first = !occupancyBuilt;
+    if (first) {
+        // every module is created before the first startup, nothing of the run is allocated yet
+        MovableRobotStats::heapAtStartup = MovableRobotStats::heapInUse();
+        chrono::duration<double,milli> loading = chrono::steady_clock::now()-MovableRobotStats::startTime;
+        MovableRobotStats::startupMs = loading.count();
+        buildOccupancy();
+        MovableRobotStats::blockCodeBytes = sizeof(MovableRobotBlockCode) + (locksUsed() ? sizeof(LockState) : 0);
+    }
+    // the handlers and the lock state depend on the mode, known once the regions are built
+    size_t heapBefore = first ? MovableRobotStats::heapInUse() : 0;
+    if (locksUsed()) locks = std::make_unique<LockState>();
+    registerHandlers();
+    if (first) MovableRobotStats::moduleStartupBytes = MovableRobotStats::heapInUse()-heapBefore;
+    if (leaderId>=0) isLeader = (node()->blockId==(bID)leaderId);
+    if (targetMissing || leaderMissing) return;
+    if (regions.count()>1) {
+        region = regions.regionOf(node()->blockId);
+        isLeader = (region==node()->blockId);
+    }
     
     //Each robot knows if a cell of the lattice is inside the target or not using the following code.
     //Here we check which robots will stay in place (target) .
-    if (target && target->isInTarget(node->position)) {
+    if (isInTarget(node()->position)) {
         //following color based on tutorial 
         //https://etudiants-stgi.pu-pm.univ-fcomte.fr/tp_bpiranda/matiereProgrammable/vs2.html
             if (Hexanodes::getWorld()->maxBlockId > 14)
             {
-                node->setColor(RED);
+                node()->setColor(RED);
             }else
             {
-                node->setColor(CYAN);
+                node()->setColor(CYAN);
             }
             
             
             inPosition = true;
         }
+    if (plannerMode) {
+        if (isLeader) startPlan();
+        return;
+    }
+
+    if (resuming) {
+        restoreState();
+        return;
+    }
+
     //from leader the broadcast message will be sent to all neighbors
     if (isLeader) {
         currentRound=1;
         distance=0;
-        nbWaitedAnswers=sendMessageToAllNeighbors("distance(1,1)",new MessageOf<pair<int,int>>(BROADCAST_MSG_ID,make_pair(distance+1,currentRound)),1000,100,0);
+        currentLeader = node()->blockId;
+        waveOpen=true;
+        waveCount = inPosition ? 1 : 0;
+        MovableRobotStats::rounds++;
+        trace(TraceRecord::ROUND,0,currentRound,distance);
+        sendWave("distance",new PairMessage(BROADCAST_MSG_ID,make_pair(distance+1,currentRound),0,region));
 	}else {
         currentRound=0;
     }
@@ -99,49 +124,110 @@ void MovableRobotBlockCode::startup() {
 //the distance between each robots 
 void MovableRobotBlockCode::myBroadcastFunc(std::shared_ptr<Message>_msg, P2PNetworkInterface*sender) {
     
-    MessageOf<pair<int,int>>* msg = static_cast<MessageOf<pair<int,int>>*>(_msg.get());
-    pair<int,int> msgData = *msg->getData();
+    PairMessage* msg = static_cast<PairMessage*>(_msg.get());
+    pair<int,int> msgData = msg->data;
+
+    // a module walking the perimeter cannot be part of the tree, it only answers the round
+    if (moving) {
+        if (msg->region == region) currentRound = max(currentRound,msgData.second);
+        else relayOf(msg->region).missed = true;
+        sendTo("acknowledgementToSender",new PairMessage(NEXT_MSG_ID, make_pair(0,0),0,msg->region),sender);
+        return;
+    }
 
-    if (isLeader){
-            isLeader = false;
-            //cout <<  "Debugging!"<< "\n"<<endl;
-        }
+    if (msg->region != region) {
+        relayWave(msg,sender);
+        return;
+    }
 
-    if (parent==nullptr || msgData.first<distance || msgData.second > currentRound) {
+    if (aggregatedWave()) {
+        echoBroadcast(msgData,sender);
+        return;
+    }
+
+    if (opensWave(msgData,currentRound)) {
+        // the round of another leader, this one ended
+        isLeader = false;
         distance=msgData.first;
-        NextFromLeader = node->blockId;
+        NextFromLeader = node()->blockId;
 
         if(inPosition){
             distanceOfNext = 0;
         }
+        else if (lockedSteps() && (noMotion || locks->lockHolder!=0 || !canLeave())) {
+            // other movers walk at the same time, the farthest module may hold them
+            distanceOfNext = 0;
+            wakeOnChange = region!=0;
+        }
         else{
             distanceOfNext = distance;
         }
 
         currentRound=msgData.second;
-        parent=sender;
-        string str="distance(";
-        str+=to_string(distance+1)+","+to_string(currentRound)+")";
-        nbWaitedAnswers=sendMessageToAllNeighbors(str.c_str(),new MessageOf<pair<int,int>>(BROADCAST_MSG_ID,make_pair(distance+1,currentRound)),1000,100,1,sender);
+        setParent(sender);
+        waveCount = inPosition ? 1 : 0;
+        trace(TraceRecord::ROUND,0,currentRound,distance);
+        clearChildren();
+        resetPending = 0;
+        resetBy = -1;
+        joining = -1;
+        waveOpen=true;
+        sendWave("distance",new PairMessage(BROADCAST_MSG_ID,make_pair(distance+1,currentRound),0,region),sender);
         
         if (nbWaitedAnswers==0) {
-            sendMessage("acknowledgementToParent",new MessageOf<pair<int,int>>(NEXT_MSG_ID, make_pair(node->blockId,distance)),parent,1000,100);
+            waveOpen=false;
+            if (incrementalElection) {
+                sendTo("subtreeToParent",subtreeReport(SUBTREE_MSG_ID),parent());
+            } else {
+                sendTo("acknowledgementToParent",new PairMessage(NEXT_MSG_ID, make_pair(node()->blockId,lockedSteps() ? distanceOfNext : distance),waveCount,region),parent());
+            }
         }
 
     } else {
-        sendMessage("acknowledgementToSender",new MessageOf<pair<int,int>>(NEXT_MSG_ID, make_pair(NextFromLeader,distanceOfNext)),sender,1000,100);
+        sendTo("acknowledgementToSender",new PairMessage(NEXT_MSG_ID, make_pair(NextFromLeader,distanceOfNext),0,region),sender);
      } 
 }
 
+//aggregated wave (--aggregate): the first BROADCAST of a round makes its sender the parent and a
+//BROADCAST crossing ours on another edge is the answer of that neighbor, so nothing is sent back
+void MovableRobotBlockCode::echoBroadcast(const pair<int,int> &msgData, P2PNetworkInterface *sender) {
+    if (opensWave(msgData,currentRound)) {
+        isLeader = false;
+        distance = msgData.first;
+        NextFromLeader = node()->blockId;
+        distanceOfNext = inPosition ? 0 : distance;
+        setBestChild(nullptr);
+        currentRound = msgData.second;
+        setParent(sender);
+        waveCount = inPosition ? 1 : 0;
+        trace(TraceRecord::ROUND,0,currentRound,distance);
+        waveOpen = true;
+        sendWave("distance",new PairMessage(BROADCAST_MSG_ID,make_pair(distance+1,currentRound),0,region),sender);
+        if (nbWaitedAnswers==0) waveAnswered();
+    } else if (msgData.second == currentRound && waveOpen) {
+        if (answered(sender) && nbWaitedAnswers==0) waveAnswered();
+    }
+}
+
 //This function will return the back message to the parents
 void MovableRobotBlockCode::myAcknowledgeFunc(std::shared_ptr<Message>_msg, P2PNetworkInterface*sender) {
-    nbWaitedAnswers--;
-    if (nbWaitedAnswers==0) {
-        if (parent!=nullptr) {
-            sendMessage("acknowledgementToParent",new Message(ACKNOWLEDGE_MSG_ID),parent,1000,100);
-            
-        } else {
-            cout <<  "parrent null!"<< "\n"<<endl;
+    PairMessage* msg = static_cast<PairMessage*>(_msg.get());
+    if (msg->region != region) {
+        relayAnswer(msg,sender);
+        return;
+    }
+    if (answered(sender) && nbWaitedAnswers==0) acknowledged();
+}
+
+void MovableRobotBlockCode::acknowledged() {
+    if (parent()!=nullptr) {
+        sendTo("acknowledgementToParent",new PairMessage(ACKNOWLEDGE_MSG_ID,make_pair(0,0),0,region),parent());
+        
+    } else {
+        // the root: the last mover is on its way and the election stayed here, elect another one while one can start
+        if (rewaveOnAck && isLeader) {
+            rewaveOnAck = false;
+            if (activeMovers < maxMovers) startWave();
         }
     }
 }
@@ -151,37 +237,94 @@ void MovableRobotBlockCode::myAcknowledgeFunc(std::shared_ptr<Message>_msg, P2PN
 
 //this function will send the information about new leader
 void MovableRobotBlockCode::acknowledgeNextFunc(std::shared_ptr<Message>_msg, P2PNetworkInterface*sender) {
-    nbWaitedAnswers--;
-
+    PairMessage* msg = static_cast<PairMessage*>(_msg.get());
+    pair<int,int> msgData = msg->data;
 
-    MessageOf<pair<int,int>>* msg = static_cast<MessageOf<pair<int,int>>*>(_msg.get());
-    pair<int,int> msgData = *msg->getData();
-
-    if (msgData.second > distanceOfNext){
-        NextFromLeader =  msgData.first;
-        distanceOfNext=msgData.second;
+    if (msg->region != region) {
+        relayAnswer(msg,sender);
+        return;
     }
-
-    if(msgData.second == distanceOfNext && NextFromLeader < msgData.first){
-      NextFromLeader = msgData.first;
-      distanceOfNext = msgData.second;
+    if (!answered(sender)) return;
+
+    // in incremental mode only the child reports (stored by subtreeFunc) carry candidates,
+    // so that the best candidate of every subtree can be reached by routing down the tree
+    if (!incrementalElection) {
+        // replies of the children carry the count of their subtree, the other ones 0
+        waveCount += msg->count;
+        if (isBetterCandidate(msgData,make_pair(NextFromLeader,distanceOfNext))) {
+            NextFromLeader = msgData.first;
+            distanceOfNext = msgData.second;
+            setBestChild(sender);
+        }
     }
 
-    if (nbWaitedAnswers==0) {
+    if (nbWaitedAnswers==0) waveAnswered();
+}
 
-        if (parent!=nullptr) {
-            sendMessage("acknowledgementToParent",new MessageOf<pair<int,int>>(NEXT_MSG_ID, make_pair(NextFromLeader,distanceOfNext)),parent,1000,100);
-            
+//all the neighbors have answered the round: report to the parent, or elect the next mover at the root
+void MovableRobotBlockCode::waveAnswered() {
+    waveOpen=false;
+    if (parent()!=nullptr) {
+        if (incrementalElection) {
+            sendTo("subtreeToParent",subtreeReport(SUBTREE_MSG_ID),parent());
         } else {
-              cout <<  "parrent null!"<< "\n"<<endl;
+            sendTo("acknowledgementToParent",new PairMessage(NEXT_MSG_ID, make_pair(NextFromLeader,distanceOfNext),waveCount,region),parent());
         }
-        
+    }
 
-        if(isLeader && nbWaitedAnswers == 0){
-            currentRound++;
-            nbWaitedAnswers=sendMessageToAllNeighbors("Broadcasting new leader!",new MessageOf<pair<int,int>>(LEADER_FOUND_MSG_ID,make_pair(NextFromLeader,currentRound)),1000,100,0);
+    if(isLeader && nbWaitedAnswers == 0){
+        if (incrementalElection) {
+            pair<int,int> best = subtreeBest();
+            if (inPosition) {
+                // a module in position never moves again: keep this tree and route the next movers through it
+                treeRoot = true;
+                if (targetComplete(subtreeCount()) || best.second == 0) finish(targetComplete(subtreeCount()));
+                else {
+                    nextRound();
+                    routeDispatch(best.first,currentRound);
+                }
+                return;
+            }
+            NextFromLeader = best.first;
+            distanceOfNext = best.second;
+        }
+        if (region && (waveCount >= (int)regions.sliceSize(region) || distanceOfNext == 0)) {
+            bool complete = waveCount >= (int)regions.sliceSize(region);
+            // a module held by the mover of another region may leave now
+            if (!complete && wakePending) startWave();
+            // the leader is the last module of the region out of position which can leave
+            else if (!complete && !inPosition && !noMotion && locks->lockHolder==0 && canLeave()) becomeMover(currentRound,true);
+            else endRegion();
             return;
         }
+        if (!incrementalElection && targetComplete(waveCount)) {
+            finish(true);
+            return;
+        }
+        if (concurrentMovers() && distanceOfNext == 0) {
+            // nothing to elect now: a mover which settled meanwhile may have freed one, otherwise the
+            // run ends after a round started with no mover walking, or the next settled mover wakes us
+            if (wakePending || (activeMovers == 0 && !quietRound)) startWave();
+            else if (activeMovers == 0) finish(false);
+            return;
+        }
+        if (!incrementalElection && distanceOfNext == 0) {
+            finish(false);
+            return;
+        }
+        nextRound();
+        if (aggregatedWave()) {
+            // the selection follows the reports leading to the mover, nothing to acknowledge
+            routeMover(NextFromLeader,currentRound);
+            return;
+        }
+        // concurrent movers: a root in position keeps the election and elects again once acknowledged,
+        // or once a mover settles when all of them walk; a root out of position passes it to the mover
+        bool passed = !concurrentMovers() || !inPosition;
+        rewaveOnAck = !passed;
+        if (concurrentMovers() && passed) isLeader = false;
+        sendWave("Broadcasting new leader!",new PairMessage(LEADER_FOUND_MSG_ID,make_pair(NextFromLeader,currentRound),passed,region));
+        return;
     }
 }
 
@@ -190,57 +333,1352 @@ void MovableRobotBlockCode::acknowledgeNextFunc(std::shared_ptr<Message>_msg, P2
 
 //Following function is selecting the new leader 
 void MovableRobotBlockCode::NewLeader(std::shared_ptr<Message>_msg,P2PNetworkInterface *sender){
-    MessageOf<pair<int,int>>* msg = static_cast<MessageOf<pair<int,int>>*>(_msg.get());
-    pair<int,int> msgData = *msg->getData();
+    PairMessage* msg = static_cast<PairMessage*>(_msg.get());
+    pair<int,int> msgData = msg->data;
 
-    if ((unsigned)msgData.first != node->blockId && currentRound < msgData.second) {
-        parent=sender;
+    if (moving) {
+        sendTo("acknowledgementToSender",new PairMessage(ACKNOWLEDGE_MSG_ID,make_pair(0,0),0,msg->region),sender);
+        return;
+    }
+    if (msg->region != region) {
+        relayWave(msg,sender);
+        return;
+    }
+
+    if ((unsigned)msgData.first != node()->blockId && currentRound < msgData.second) {
+        setParent(sender);
         currentRound = msgData.second;
-        string str="distance(";
-        str+=to_string(distance+1)+","+to_string(currentRound)+")";
-        nbWaitedAnswers=sendMessageToAllNeighbors(str.c_str(),new MessageOf<pair<int,int>>(LEADER_FOUND_MSG_ID,make_pair(msgData.first,msgData.second)),1000,100,1,sender);
+        sendWave("distance",new PairMessage(LEADER_FOUND_MSG_ID,make_pair(msgData.first,msgData.second),msg->count,region),sender);
 
         if (nbWaitedAnswers==0) {
-            sendMessage("acknowledgementToParent",new Message(ACKNOWLEDGE_MSG_ID),parent,1000,100);
+            sendTo("acknowledgementToParent",new PairMessage(ACKNOWLEDGE_MSG_ID,make_pair(0,0),0,region),parent());
         }
 
 
     } else {
-        sendMessage("acknowledgementToSender",new Message(ACKNOWLEDGE_MSG_ID),sender,1000,100);
+        sendTo("acknowledgementToSender",new PairMessage(ACKNOWLEDGE_MSG_ID,make_pair(0,0),0,region),sender);
     }
 
 
 
-    if ((unsigned)msgData.first == node->blockId && currentRound < msgData.second){
+    if ((unsigned)msgData.first == node()->blockId && currentRound < msgData.second){
 
         if(inPosition){
             return;
         }
 
 
-        sendMessage("acknowledgementToParent",new Message(ACKNOWLEDGE_MSG_ID),parent,1000,100);
-        isLeader = true;
-        currentRound = msgData.second;
-        distance=0;
-        parent = nullptr;
-        distanceOfNext=0;
-        vector<HexanodesMotion*> tab = Hexanodes::getWorld()->getAllMotionsForModule(node);
+        sendTo("acknowledgementToParent",new PairMessage(ACKNOWLEDGE_MSG_ID,make_pair(0,0),0,region),parent());
+        becomeMover(msgData.second,msg->count);
+    }
+}
+
+void MovableRobotBlockCode::becomeMover(int round, bool leads) {
+    // concurrent movers: the election stays with the root while more movers can start
+    isLeader = leads || !concurrentMovers();
+    currentLeader = node()->blockId;
+    moving = true;
+    walkSteps = 0;
+    if (locks) {
+        locks->walkTurn = -1;
+        locks->walkTurnGap = -1;
+    }
+    MovableRobotStats::elections++;
+    currentRound = round;
+    trace(TraceRecord::LEADER,0,currentRound);
+    distance=0;
+    setParent(nullptr);
+    distanceOfNext=0;
+    // the rounds of the module are over, its answers are not waited for anymore
+    waveOpen=false;
+    pendingMask=0;
+    nbWaitedAnswers=0;
+    if (concurrentMovers()) activeMovers++;
+    // the modules of another region wait for the answers it relays, it leaves once they are sent
+    if (relaying()) holdMotion = true;
+    else walkStep();
+}
+
+//aggregated wave: the selection goes down to the child which reported the mover
+void MovableRobotBlockCode::routeMover(int id, int round) {
+    if (id == (int)node()->blockId) {
+        if (!inPosition) becomeMover(round,true);
+    } else if (bestChild()!=nullptr && bestChild()->isConnected()) {
+        sendTo("dispatch",new PairMessage(DISPATCH_MSG_ID,make_pair(id,round)),bestChild());
+    }
+}
+
+
+
+//all the messages of the block code go through these two functions
+int MovableRobotBlockCode::sendTo(const char *name, Message *msg, P2PNetworkInterface *dest, Time after) {
+    MovableRobotStats::countMessage(msg->type);
+    if (MovableRobotTrace::enabled) trace(TraceRecord::SEND,msg->type,interfaceIndex(dest),1);
+    if (incrementalElection) return sendMessage(name,msg,dest,inOrder(after+timing.drawDelay()),0);
+    if (timing.coreJitter()) return sendMessage(name,msg,dest,after+timing.baseDelay(),timing.coreJitterRange());
+    return sendMessage(name,msg,dest,after+timing.drawDelay(),0);
+}
+
+int MovableRobotBlockCode::sendToNeighbors(const char *name, Message *msg, P2PNetworkInterface *except) {
+    int type = msg->type;
+    int n = 0;
+    if (timing.coreJitter() && !incrementalElection) {
+        n = except ? sendMessageToAllNeighbors(name,msg,timing.baseDelay(),timing.coreJitterRange(),1,except)
+                   : sendMessageToAllNeighbors(name,msg,timing.baseDelay(),timing.coreJitterRange(),0);
+    } else {
+        // one latency drawn by the timing model for each copy
+        for (P2PNetworkInterface *itf : node()->P2PNetworkInterfaces) {
+            if (itf!=except && itf->isConnected()) {
+                Time delay = timing.drawDelay();
+                sendMessage(name,msg->clone(),itf,incrementalElection ? inOrder(delay) : delay,0);
+                n++;
+            }
+        }
+        delete msg;
+    }
+    MovableRobotStats::countMessage(type,n);
+    trace(TraceRecord::SEND,type,-1,n);
+    return n;
+}
+
+Time MovableRobotBlockCode::inOrder(Time delay) {
+    // a message scheduled at the date of the previous one is still queued after it
+    Time now = getScheduler()->now();
+    lastSendDate = max(lastSendDate,now+delay);
+    return lastSendDate-now;
+}
+
+void MovableRobotBlockCode::trace(uint16_t kind, uint16_t msgType, int32_t a, int32_t b) const {
+    MovableRobotTrace::record(getScheduler()->now(),node()->blockId,kind,msgType,a,b);
+}
+
+// incremental election, SETTLED is a SUBTREE report asking the root for the next mover
+const MovableRobotBlockCode::MessageHandler MovableRobotBlockCode::handlers[NB_MSG_TYPES] = {
+    &MovableRobotBlockCode::myBroadcastFunc,        // BROADCAST
+    &MovableRobotBlockCode::myAcknowledgeFunc,      // ACKNOWLEDGE
+    &MovableRobotBlockCode::acknowledgeNextFunc,    // NEXT
+    &MovableRobotBlockCode::NewLeader,              // LEADER_FOUND
+    &MovableRobotBlockCode::subtreeFunc,            // SUBTREE
+    &MovableRobotBlockCode::subtreeFunc,            // SETTLED
+    &MovableRobotBlockCode::repairFunc,             // REPAIR
+    &MovableRobotBlockCode::resetFunc,              // RESET
+    &MovableRobotBlockCode::dispatchFunc,           // DISPATCH
+    &MovableRobotBlockCode::lockFunc,               // LOCK
+    &MovableRobotBlockCode::grantFunc,              // GRANT
+    &MovableRobotBlockCode::unlockFunc,             // UNLOCK
+    &MovableRobotBlockCode::releasedFunc,           // RELEASED
+    &MovableRobotBlockCode::wakeFunc,               // WAKE
+    &MovableRobotBlockCode::lockFunc                // RESERVE
+};
+
+eventFunc2 MovableRobotBlockCode::traced() {
+    return [this](std::shared_ptr<Message> msg, P2PNetworkInterface *sender) {
+        // the period is checked once every 1024 messages, before this one counts as received
+        if (!metricsFile.empty() && (MovableRobotStats::received & 1023)==0) exportMetrics();
+        MovableRobotStats::received++;
+        if (MovableRobotTrace::enabled) trace(TraceRecord::RECEIVE,msg->type,interfaceIndex(sender));
+        (this->*handlers[msg->type-FIRST_MSG_ID])(msg,sender);
+    };
+}
+
+void MovableRobotBlockCode::registerHandlers() {
+    // the four types of the flooded election, of every mode, then the ones of the incremental election,
+    // of the routed selection (--aggregate) and of the locks
+    for (int type=BROADCAST_MSG_ID; type<=LEADER_FOUND_MSG_ID; type++) addMessageEventFunc2(type,traced());
+    if (incrementalElection) {
+        for (int type=SUBTREE_MSG_ID; type<=RESET_MSG_ID; type++) addMessageEventFunc2(type,traced());
+    }
+    if (incrementalElection || aggregatedWave()) addMessageEventFunc2(DISPATCH_MSG_ID,traced());
+    if (locks) {
+        for (int type=LOCK_MSG_ID; type<=RESERVE_MSG_ID; type++) addMessageEventFunc2(type,traced());
+    }
+}
+
+bool MovableRobotBlockCode::isInTarget(const Cell3DPosition &p) const {
+    if (compactTargetLoaded) return compactTarget.isInTarget(p);
+    return target && target->isInTarget(p);
+}
+
+bool MovableRobotBlockCode::canLeave() const {
+    return removable();
+}
+
+bool MovableRobotBlockCode::removable(uint8_t ignored) const {
+    // the interfaces go around the module, count the starts of the runs of connected ones
+    const vector<P2PNetworkInterface*> &itfs = node()->P2PNetworkInterfaces;
+    int runs = 0, last = itfs.size()-1;
+    bool previous = itfs[last]->isConnected() && !(ignored & (1<<last)), free = false;
+    for (size_t i=0; i<itfs.size(); i++) {
+        bool connected = itfs[i]->isConnected();
+        free |= !connected;
+        connected &= !(ignored & (1<<i));
+        runs += connected && !previous;
+        previous = connected;
+    }
+    return free && runs<=1;
+}
+
+void MovableRobotBlockCode::endRegion() {
+    activeRegions--;
+    if (waveCount < (int)regions.sliceSize(region)) {
+        // its modules out of position are held by the movers of the other regions, or cannot leave yet
+        regionWaiting = true;
+        wakeOnChange = !inPosition;
+    } else {
+        cout << "region " << region << " done at " << getScheduler()->now()+MovableRobotStats::timeOffset << endl;
+    }
+    if (activeRegions<=0) finish(compactTargetLoaded && occupancy.freeTargetCells()==0);
+}
+
+void MovableRobotBlockCode::resumeRegion() {
+    regionWaiting = false;
+    activeRegions++;
+    startWave();
+}
+
+void MovableRobotBlockCode::wakeLeader() {
+    wakeOnChange = false;
+    if (isLeader) {
+        if (regionWaiting && !moving && !finished) resumeRegion();
+        else if (waveOpen || nbWaitedAnswers>0) wakePending = true;
+        return;
+    }
+    if (currentRound <= locks->lastWake) return;
+    locks->lastWake = currentRound;
+    if (parent()!=nullptr && parent()->isConnected()) {
+        sendTo("wake",new PairMessage(WAKE_MSG_ID,make_pair(0,currentRound),0,region),parent());
+    } else {
+        sendToNeighbors("wake",new PairMessage(WAKE_MSG_ID,make_pair(0,currentRound),0,region));
+    }
+}
+
+int MovableRobotBlockCode::interfaceIndex(P2PNetworkInterface *itf) const {
+    for (size_t i=0; i<node()->P2PNetworkInterfaces.size(); i++) {
+        if (node()->P2PNetworkInterfaces[i]==itf) return i;
+    }
+    return -1;
+}
+
+uint8_t MovableRobotBlockCode::neighborMask(P2PNetworkInterface *except) const {
+    uint8_t mask = 0;
+    for (size_t i=0; i<node()->P2PNetworkInterfaces.size(); i++) {
+        P2PNetworkInterface *itf = node()->P2PNetworkInterfaces[i];
+        if (itf!=except && itf->isConnected()) mask |= 1<<i;
+    }
+    return mask;
+}
+
+void MovableRobotBlockCode::sendWave(const char *name, PairMessage *msg, P2PNetworkInterface *except) {
+    pendingMask = neighborMask(except);
+    nbWaitedAnswers = sendToNeighbors(name,msg,except);
+}
+
+bool MovableRobotBlockCode::answered(P2PNetworkInterface *sender) {
+    int i = interfaceIndex(sender);
+    if (i<0 || !(pendingMask & (1<<i))) return false;
+    pendingMask &= ~(1<<i);
+    nbWaitedAnswers--;
+    return true;
+}
+
+//a neighbor which started a motion cannot answer anymore, it is out of the wave
+void MovableRobotBlockCode::answersLost() {
+    uint8_t connected = neighborMask();
+    uint8_t lost = pendingMask & ~connected;
+    if (lost) {
+        pendingMask &= ~lost;
+        for (; lost; lost &= lost-1) nbWaitedAnswers--;
+        if (nbWaitedAnswers==0) {
+            if (waveOpen) waveAnswered();
+            else acknowledged();
+        }
+    }
+    if (!locks) return;
+    for (Relay &r : locks->relays) {
+        lost = r.pendingMask & ~connected;
+        if (!lost) continue;
+        r.pendingMask &= ~lost;
+        for (; lost; lost &= lost-1) r.nbWaitedAnswers--;
+        if (r.nbWaitedAnswers==0) relayAnswered(r);
+    }
+}
+
+MovableRobotBlockCode::Relay &MovableRobotBlockCode::relayOf(bID r) {
+    for (Relay &relay : locks->relays) {
+        if (relay.region==r) return relay;
+    }
+    locks->relays.push_back(Relay{r,0,make_pair(0,0),0,-1,-1,0,0,0,false,false});
+    return locks->relays.back();
+}
+
+bool MovableRobotBlockCode::relaying() const {
+    if (!locks) return false;
+    for (const Relay &r : locks->relays) {
+        if (r.nbWaitedAnswers>0) return true;
+    }
+    return false;
+}
+
+void MovableRobotBlockCode::relayWave(PairMessage *msg, P2PNetworkInterface *sender) {
+    Relay &r = relayOf(msg->region);
+    bool election = msg->type==BROADCAST_MSG_ID;
+    if (msg->data.second <= r.round) {
+        sendTo("relayAnswer",new PairMessage(election ? NEXT_MSG_ID : ACKNOWLEDGE_MSG_ID,make_pair(0,0),0,msg->region),sender);
+        return;
+    }
+    r.round = msg->data.second;
+    r.election = election;
+    r.parentIndex = interfaceIndex(sender);
+    r.treeIndex = r.parentIndex;
+    r.best = make_pair(0,0);
+    r.count = 0;
+    r.pendingMask = neighborMask(sender);
+    // the distances of the region count the hops through the relays
+    pair<int,int> data = election ? make_pair(msg->data.first+1,msg->data.second) : msg->data;
+    r.nbWaitedAnswers = sendToNeighbors("relay",new PairMessage(msg->type,data,election ? 0 : msg->count,msg->region),sender);
+    if (r.nbWaitedAnswers==0) relayAnswered(r);
+}
+
+void MovableRobotBlockCode::relayWake(PairMessage *msg, P2PNetworkInterface *sender) {
+    Relay &r = relayOf(msg->region);
+    if (r.round <= r.woken) return;
+    r.woken = r.round;
+    P2PNetworkInterface *p = interfaceAt(r.treeIndex);
+    if (p!=nullptr && p->isConnected()) {
+        sendTo("relayWake",new PairMessage(WAKE_MSG_ID,msg->data,0,msg->region),p);
+    } else {
+        sendToNeighbors("relayWake",new PairMessage(WAKE_MSG_ID,msg->data,0,msg->region),sender);
+    }
+}
+
+void MovableRobotBlockCode::relayAnswer(PairMessage *msg, P2PNetworkInterface *sender) {
+    int i = interfaceIndex(sender);
+    for (Relay &r : locks->relays) {
+        if (r.region!=msg->region) continue;
+        if (i<0 || !(r.pendingMask & (1<<i))) return;
+        r.pendingMask &= ~(1<<i);
+        r.nbWaitedAnswers--;
+        if (msg->type==NEXT_MSG_ID) {
+            r.count += msg->count;
+            if (isBetterCandidate(msg->data,r.best)) r.best = msg->data;
+        }
+        if (r.nbWaitedAnswers==0) relayAnswered(r);
+        return;
+    }
+}
+
+void MovableRobotBlockCode::relayAnswered(Relay &r) {
+    P2PNetworkInterface *p = interfaceAt(r.parentIndex);
+    if (p!=nullptr && p->isConnected()) {
+        sendTo("relayToParent",r.election ? new PairMessage(NEXT_MSG_ID,r.best,r.count,r.region)
+                                          : new PairMessage(ACKNOWLEDGE_MSG_ID,make_pair(0,0),0,r.region),p);
+    }
+    r.parentIndex = -1;
+    if (holdMotion && !relaying()) {
+        holdMotion = false;
+        walkStep();
+    }
+}
+
+Message *MovableRobotBlockCode::subtreeReport(int type) const {
+    return new PairMessage(type,subtreeBest(),subtreeCount());
+}
+
+bool MovableRobotBlockCode::targetComplete(int count) {
+    // every module is counted once, along the chain of its current parents
+    return compactTargetLoaded && count == (int)compactTarget.size();
+}
+
+void MovableRobotBlockCode::finish(bool complete) {
+    if (finished) return;
+    finished = true;
+    MovableRobotStats::completed = complete;
+    cout << "reconfiguration " << (complete ? "complete" : "stopped, no module can move") << " at "
+         << getScheduler()->now()+MovableRobotStats::timeOffset << ": " << nMotions << " motions, "
+         << MovableRobotStats::elections << " movers, " << MovableRobotStats::rounds << " rounds, "
+         << MovableRobotStats::totalMessages() << " messages" << endl;
+    if (!complete && compactTargetLoaded) {
+        cout << occupancy.freeTargetCells() << " cells of the target are still free" << endl;
+    }
+    // messages still in flight are dropped, nothing depends on them anymore
+    getScheduler()->stop(getScheduler()->now());
+}
+
+//same order as acknowledgeNextFunc: the farthest module first, then the highest id
+pair<int,int> MovableRobotBlockCode::subtreeBest() const {
+    pair<int,int> best = (inPosition || moving) ? make_pair(0,0) : make_pair((int)node()->blockId,distance);
+
+    for (int i=0; i<HHLattice::MAX_NB_NEIGHBORS; i++) {
+        if (!(childMask & (1<<i))) continue;
+        const pair<int,int> &c = childBest[i];
+        if (isBetterCandidate(c,best)) best = c;
+    }
+    return best;
+}
+
+int MovableRobotBlockCode::subtreeCount() const {
+    int n = inPosition ? 1 : 0;
+    for (int i=0; i<HHLattice::MAX_NB_NEIGHBORS; i++) {
+        if (childMask & (1<<i)) n += childCount[i];
+    }
+    return n;
+}
+
+void MovableRobotBlockCode::clearChildren() {
+    childMask = 0;
+    for (auto &c : childBest) c = make_pair(0,0);
+    for (int &c : childCount) c = 0;
+}
+
+//sends the mover selection down to the child whose subtree holds the candidate
+void MovableRobotBlockCode::routeDispatch(int id, int round) {
+    if (id == (int)node()->blockId) {
+        if (!inPosition && !moving) {
+            startMoving(round);
+            return;
+        }
+    } else {
+        for (int i=0; i<HHLattice::MAX_NB_NEIGHBORS; i++) {
+            if ((childMask & (1<<i)) && childBest[i].first == id && childBest[i].second > 0) {
+                sendTo("dispatch",new PairMessage(DISPATCH_MSG_ID,make_pair(id,round)),node()->P2PNetworkInterfaces[i]);
+                return;
+            }
+        }
+    }
+
+    // stale route (the tree changed meanwhile): take the best candidate of this subtree instead
+    pair<int,int> best = subtreeBest();
+    if (best.second > 0 && best.first != id) {
+        routeDispatch(best.first,round);
+        return;
+    }
+    // nothing left to move here, refresh the ancestors so that the root picks another one; out of the
+    // tree, the request goes up once the module is attached again
+    if (parent()!=nullptr) {
+        sendTo("settledToParent",subtreeReport(SETTLED_MSG_ID),parent());
+    } else if (treeRoot) {
+        dispatchWaiting = true;
+    } else {
+        awaitingSettle = true;
+    }
+}
+
+void MovableRobotBlockCode::startMoving(int round) {
+    if (parent()!=nullptr) {
+        sendTo("detachFromParent",new PairMessage(SUBTREE_MSG_ID,make_pair(-1,-1)),parent());
+    }
+    // the children look for other parents, the mover may stay next to them; a reset module elected
+    // meanwhile does not wait for its children to leave the tree
+    for (int i=0; i<HHLattice::MAX_NB_NEIGHBORS; i++) {
+        if ((childMask & (1<<i)) && node()->P2PNetworkInterfaces[i]->isConnected()) {
+            sendTo("resetChild",new PairMessage(RESET_MSG_ID),node()->P2PNetworkInterfaces[i]);
+        }
+    }
+    if (resetBy>=0 && interfaceAt(resetBy)->isConnected()) {
+        sendTo("detachFromParent",new PairMessage(SUBTREE_MSG_ID,make_pair(-1,-1)),interfaceAt(resetBy));
+    }
+    if (joining>=0 && interfaceAt(joining)->isConnected()) {
+        sendTo("detachFromParent",new PairMessage(SUBTREE_MSG_ID,make_pair(-1,-1)),interfaceAt(joining));
+    }
+    resetPending = 0;
+    resetBy = -1;
+    joining = -1;
+    setParent(nullptr);
+    clearChildren();
+    moving = true;
+    currentLeader = node()->blockId;
+    walkSteps = 0;
+    incrementalSettle = true;
+    MovableRobotStats::elections++;
+    currentRound = round;
+    trace(TraceRecord::LEADER,0,currentRound);
+    walkStep();
+}
+
+//the parent has moved away or reset this module: detach the whole subtree and let every module of it rejoin
+//through its neighbors, from the bottom up
+void MovableRobotBlockCode::resetSubtree(int by) {
+    resetPending = 0;
+    for (int i=0; i<HHLattice::MAX_NB_NEIGHBORS; i++) {
+        if ((childMask & (1<<i)) && node()->P2PNetworkInterfaces[i]->isConnected()) {
+            sendTo("resetChild",new PairMessage(RESET_MSG_ID),node()->P2PNetworkInterfaces[i]);
+            resetPending |= 1<<i;
+        }
+    }
+    resetBy = by;
+    joining = -1;
+    setParent(nullptr);
+    distance = 0;
+    clearChildren();
+    if (resetPending==0) resetDone();
+}
+
+void MovableRobotBlockCode::resetDone() {
+    P2PNetworkInterface *by = interfaceAt(resetBy);
+    if (by!=nullptr && by->isConnected()) {
+        sendTo("detachFromParent",new PairMessage(SUBTREE_MSG_ID,make_pair(-1,-1)),by);
+    }
+    resetBy = -1;
+    sendToNeighbors("repairProbe",new PairMessage(REPAIR_MSG_ID,make_pair(0,currentRound)));
+}
+
+//candidate report of a child subtree, (-1,-1) when the child leaves
+void MovableRobotBlockCode::subtreeFunc(std::shared_ptr<Message>_msg, P2PNetworkInterface*sender) {
+    PairMessage* msg = static_cast<PairMessage*>(_msg.get());
+    pair<int,int> msgData = msg->data;
+    int i = interfaceIndex(sender);
+
+    if (i<0) return;
+    if (msgData.first < 0 && (resetPending & (1<<i))) {
+        // a child told to leave the tree has left it with its own children
+        resetPending &= ~(1<<i);
+        if (resetPending==0) resetDone();
+        return;
+    }
+    if (msgData.first >= 0 && (moving || (parent()==nullptr && !treeRoot && !isLeader))) {
+        // a module walking or out of the tree takes no child: the sender looks for another parent, and
+        // the offers it sent before it knows are ignored until it has left (a request for a mover waits
+        // for the next parent)
+        sendTo("resetChild",new PairMessage(RESET_MSG_ID),sender);
+        if (!moving) {
+            resetPending |= 1<<i;
+            if (_msg->type == SETTLED_MSG_ID) awaitingSettle = true;
+        }
+        return;
+    }
+    if (moving) return;
+    if (msgData.first >= 0 && !(childMask & (1<<i)) && !waveOpen) {
+        // a module attaching through this one
+        sendTo("repairAccept",new PairMessage(REPAIR_MSG_ID,make_pair(-(distance+1),currentRound)),sender);
+    }
+
+    pair<int,int> before = subtreeBest();
+    int countBefore = subtreeCount();
+    if (msgData.first < 0) {
+        childMask &= ~(1<<i);
+        childBest[i] = make_pair(0,0);
+        childCount[i] = 0;
+    } else {
+        childMask |= (1<<i);
+        childBest[i] = msgData;
+        childCount[i] = msg->count;
+    }
+
+    // reports closing a flooded round are also answers of that round
+    if (waveOpen && msgData.first >= 0 && _msg->type == SUBTREE_MSG_ID) {
+        acknowledgeNextFunc(_msg, sender);
+        return;
+    }
+
+    pair<int,int> best = subtreeBest();
+    if (treeRoot) {
+        if (targetComplete(subtreeCount())) finish(true);
+        else if (_msg->type == SETTLED_MSG_ID || dispatchWaiting) {
+            // the modules out of position may all be rejoining the tree, the next report brings them
+            dispatchWaiting = best.second == 0;
+            if (!dispatchWaiting) {
+                nextRound();
+                routeDispatch(best.first,currentRound);
+            }
+        }
+        return;
+    }
+    if (parent()==nullptr) return;
+
+    if (_msg->type == SETTLED_MSG_ID) {
+        sendTo("settledToParent",subtreeReport(SETTLED_MSG_ID),parent());
+    } else if (best != before || subtreeCount() != countBefore) {
+        sendTo("subtreeToParent",subtreeReport(SUBTREE_MSG_ID),parent());
+    }
+}
+
+//(0,round) probes the neighbors for their distance, (d,round) offers a detached module to attach at distance d
+//and (-d,round) accepts its report
+void MovableRobotBlockCode::repairFunc(std::shared_ptr<Message>_msg, P2PNetworkInterface*sender) {
+    PairMessage* msg = static_cast<PairMessage*>(_msg.get());
+    pair<int,int> msgData = msg->data;
+
+    if (moving) return;
+
+    if (msgData.first == 0) {
+        if (treeRoot || parent()!=nullptr) {
+            sendTo("repairOffer",new PairMessage(REPAIR_MSG_ID,make_pair(distance+1,currentRound)),sender);
+        }
+        return;
+    }
+
+    int i = interfaceIndex(sender);
+    if (msgData.first < 0) {
+        if (i<0 || i!=joining) return;
+        joining = -1;
+        setParent(sender);
+        distance = -msgData.first;
+        if (awaitingSettle) {
+            // a mover requested while the report was on its way
+            awaitingSettle = false;
+            sendTo("settledToParent",subtreeReport(SETTLED_MSG_ID),parent());
+        }
+        // the detached neighbors can attach through this module
+        sendToNeighbors("repairOffer",new PairMessage(REPAIR_MSG_ID,make_pair(distance+1,currentRound)),sender);
+        return;
+    }
+
+    // an attached module keeps its parent, even for a shorter path: a switch would be reported by both
+    // parents and the root would count the subtree twice until the old parent is updated. A reset module
+    // waits for its children to leave the tree, the offer may come from below one of them
+    if (treeRoot || isLeader || parent()!=nullptr || resetPending!=0 || joining>=0 || i<0) return;
+
+    childMask &= ~(1<<i);
+    childBest[i] = make_pair(0,0);
+    childCount[i] = 0;
+    joining = i;
+    if (awaitingSettle) {
+        awaitingSettle = false;
+        sendTo("settledToParent",subtreeReport(SETTLED_MSG_ID),sender);
+    } else {
+        sendTo("subtreeToParent",subtreeReport(SUBTREE_MSG_ID),sender);
+    }
+}
+
+void MovableRobotBlockCode::resetFunc(std::shared_ptr<Message>_msg, P2PNetworkInterface*sender) {
+    if (!moving && (sender==parent() || interfaceIndex(sender)==joining)) {
+        resetSubtree(interfaceIndex(sender));
+    } else {
+        // not a child of the sender anymore, which waits for this detach
+        sendTo("detachFromParent",new PairMessage(SUBTREE_MSG_ID,make_pair(-1,-1)),sender);
+    }
+}
+
+void MovableRobotBlockCode::dispatchFunc(std::shared_ptr<Message>_msg, P2PNetworkInterface*sender) {
+    PairMessage* msg = static_cast<PairMessage*>(_msg.get());
+
+    if (moving) return;
+    if (!incrementalElection) {
+        routeMover(msg->data.first,msg->data.second);
+        return;
+    }
+    routeDispatch(msg->data.first,msg->data.second);
+}
+
+
+
+void MovableRobotBlockCode::buildOccupancy() {
+    vector<Cell3DPosition> cells;
+    for (auto &b : BaseSimulator::getWorld()->buildingBlocksMap) {
+        cells.push_back(b.second->position);
+    }
+    occupancy.build(static_cast<HHLattice*>(Hexanodes::getWorld()->lattice),cells,
+                    compactTargetLoaded ? &compactTarget : nullptr);
+    occupancyBuilt = true;
+
+    // without a target every module is out of position and would walk forever
+    if (!compactTargetLoaded && target==nullptr) {
+        cerr << "no target: the world needs a grid <target> of <cell> or <rect> elements, nothing is moved" << endl;
+        targetMissing = true;
+    }
+    if (leaderId>=0 && BaseSimulator::getWorld()->getBlockById(leaderId)==nullptr) {
+        cerr << "--leader-id " << leaderId << " is not a module of the world, nothing is moved" << endl;
+        leaderMissing = true;
+    }
+
+    // the length of both walks depends on the whole surface, which only the planner knows
+    if (shortestPath && !plannerMode) {
+        cerr << "--shortest is an option of --planner, the movers walk clockwise" << endl;
+        shortestPath = false;
+    }
+
+    // several leaders (leader="true" blocks or --regions) split the configuration into regions
+    map<bID,Cell3DPosition> modules;
+    vector<bID> leaders;
+    for (auto &b : BaseSimulator::getWorld()->buildingBlocksMap) {
+        modules[b.first] = b.second->position;
+        if (static_cast<MovableRobotBlockCode*>(b.second->blockCode)->isLeader) leaders.push_back(b.first);
+    }
+    if (leaderId>=0) leaders.assign(1,(bID)leaderId);
+    if (max(leaders.size(),nbRegions)>1) {
+        if (incrementalElection || maxMovers>1 || plannerMode || aggregateAnswers) {
+            cerr << "regions need the flooded election with one mover and no --aggregate, a single leader is used" << endl;
+            // the first leader of the world keeps the role, startup() demotes the others
+            if (!leaders.empty()) leaderId = leaders.front();
+        } else {
+            regions.build(static_cast<HHLattice*>(Hexanodes::getWorld()->lattice),modules,leaders,nbRegions,
+                          compactTargetLoaded ? &compactTarget : nullptr);
+            activeRegions = regions.count();
+            MovableRobotStats::regions = regions.count();
+            cout << regions.count() << " regions" << endl;
+        }
+    }
+    // the other modes have no point where no message is in flight, see MovableRobotCheckpoint
+    if (!checkpointFile.empty() && (incrementalElection || concurrentMovers() || plannerMode || regions.count()>1)) {
+        cerr << "--checkpoint needs the flooded election with one mover and one region, no snapshot is written" << endl;
+        checkpointFile.clear();
+    }
+}
+
+bool MovableRobotBlockCode::concurrentMovers() {
+    return maxMovers > 1 && !incrementalElection;
+}
+
+bool MovableRobotBlockCode::locksUsed() {
+    return concurrentMovers() || regions.count()>1;
+}
+
+bool MovableRobotBlockCode::aggregatedWave() {
+    return aggregateAnswers && !incrementalElection && !concurrentMovers();
+}
+
+void MovableRobotBlockCode::startWave() {
+    distance=0;
+    isLeader=true;
+    currentLeader = node()->blockId;
+    nextRound();
+    // the candidate of the last round may be walking already
+    NextFromLeader = node()->blockId;
+    distanceOfNext = 0;
+    wakePending = false;
+    quietRound = activeMovers==0;
+    setBestChild(nullptr);
+    waveOpen=true;
+    waveCount = inPosition ? 1 : 0;
+    MovableRobotStats::rounds++;
+    trace(TraceRecord::ROUND,0,currentRound,distance);
+    sendWave("distance",new PairMessage(BROADCAST_MSG_ID,make_pair(distance+1,currentRound),0,region));
+}
+
+void MovableRobotBlockCode::saveCheckpoint() {
+    if (MovableRobotStats::received!=MovableRobotStats::totalMessages()) return;
+
+    MovableRobotCheckpoint cp;
+    cp.header.date = getScheduler()->now()+MovableRobotStats::timeOffset;
+    cp.header.motions = nMotions;
+    cp.header.rounds = MovableRobotStats::rounds;
+    cp.header.elections = MovableRobotStats::elections;
+    cp.header.messagesReceived = MovableRobotStats::received;
+    cp.header.motionLookups = MovableRobotStats::motionLookups;
+    cp.header.motionCacheHits = MovableRobotStats::motionCacheHits;
+    cp.header.leader = node()->blockId;
+    cp.messages.assign(MovableRobotStats::messages,MovableRobotStats::messages+NB_MSG_TYPES);
+    for (auto &b : BaseSimulator::getWorld()->buildingBlocksMap) {
+        MovableRobotBlockCode *code = static_cast<MovableRobotBlockCode*>(b.second->blockCode);
+        MovableRobotCheckpoint::ModuleState m = {};
+        m.blockId = b.first;
+        m.x = code->node()->position[0];
+        m.y = code->node()->position[1];
+        m.z = code->node()->position[2];
+        m.orientationCode = code->node()->orientationCode;
+        m.flags = (code->inPosition ? MovableRobotCheckpoint::IN_POSITION : 0)
+                | (code->isLeader ? MovableRobotCheckpoint::IS_LEADER : 0);
+        m.distance = code->distance;
+        m.currentRound = code->currentRound;
+        m.nextFromLeader = code->NextFromLeader;
+        m.distanceOfNext = code->distanceOfNext;
+        m.parent = code->parentIndex;
+        cp.modules.push_back(m);
+    }
+    if (!cp.save(checkpointFile)) cerr << "cannot write checkpoint " << checkpointFile << endl;
+}
+
+void MovableRobotBlockCode::restoreState() {
+    const vector<MovableRobotCheckpoint::ModuleState> &modules = resumed.modules;
+    // modules are stored in block id order, ids start at 1
+    size_t i = node()->blockId-1;
+    if (i>=modules.size() || modules[i].blockId!=node()->blockId) {
+        cerr << "module " << node()->blockId << " is not in the snapshot" << endl;
+        return;
+    }
+    const MovableRobotCheckpoint::ModuleState &m = modules[i];
+    inPosition = m.flags & MovableRobotCheckpoint::IN_POSITION;
+    isLeader = m.flags & MovableRobotCheckpoint::IS_LEADER;
+    distance = m.distance;
+    currentRound = m.currentRound;
+    NextFromLeader = m.nextFromLeader;
+    distanceOfNext = m.distanceOfNext;
+    parentIndex = m.parent;
+
+    if (node()->blockId==resumed.header.leader) startWave();
+}
+
+bool MovableRobotBlockCode::resume(const string &snapshot, string &config) {
+    if (!resumed.load(snapshot)) {
+        cerr << "cannot read snapshot " << snapshot << endl;
+        return false;
+    }
+    string resumedConfig = snapshot + ".xml";
+    if (!resumed.writeConfig(config,resumedConfig)) {
+        cerr << "cannot write the configuration of the snapshot from " << config << endl;
+        return false;
+    }
+    config = resumedConfig;
+    resuming = true;
+
+    const MovableRobotCheckpoint::Header &h = resumed.header;
+    nMotions = h.motions;
+    MovableRobotStats::rounds = h.rounds;
+    MovableRobotStats::elections = h.elections;
+    MovableRobotStats::received = h.messagesReceived;
+    MovableRobotStats::motionLookups = h.motionLookups;
+    MovableRobotStats::motionCacheHits = h.motionCacheHits;
+    MovableRobotStats::makespan = h.date;
+    MovableRobotStats::timeOffset = h.date;
+    for (size_t i=0; i<resumed.messages.size() && i<(size_t)NB_MSG_TYPES; i++) {
+        MovableRobotStats::messages[i] = resumed.messages[i];
+    }
+    return true;
+}
+
+//one election runs at a time, the rounds of the module which starts it follow the ones it has seen
+void MovableRobotBlockCode::nextRound() {
+    currentRound++;
+}
+
+bool MovableRobotBlockCode::closesHole(const Cell3DPosition &p) const {
+    // a pocket of a few free cells next to p would be closed: cells of the target no walk reaches again, or
+    // cells out of it in a ring of modules still to leave, none of which can leave its cell
+    const int POCKET = 8;
+    HHLattice *lattice = static_cast<HHLattice*>(Hexanodes::getWorld()->lattice);
+    bool taken[HHLattice::MAX_NB_NEIGHBORS], settled[HHLattice::MAX_NB_NEIGHBORS], holeOfTarget = false;
+    for (int d=0; d<HHLattice::MAX_NB_NEIGHBORS; d++) {
+        Cell3DPosition cell = lattice->getCellInDirection(p,d);
+        taken[d] = occupancy.isOccupied(cell);
+        bool targetHole;
+        if (!taken[d] && occupancy.pocket(cell,POCKET,targetHole)<=POCKET) {
+            // a hole of the target itself is closed on purpose
+            if (!targetHole) return true;
+            holeOfTarget = true;
+        }
+        // the lattice does not hold a module during its motion, the index holds it in its origin until the end
+        BuildingBlock *b = taken[d] ? lattice->getBlock(cell) : nullptr;
+        settled[d] = b!=nullptr && !static_cast<MovableRobotBlockCode*>(b->blockCode)->moving;
+    }
+    if (holeOfTarget) return false;
+    // the module would join two arcs of modules around p, the free cells on one side of it would be walled
+    // in however many they are. A mover next to p may be down there with them or about to leave: the arcs
+    // are counted with the movers and without them
+    int arcs = 0, settledArcs = 0;
+    for (int d=0, prev=HHLattice::MAX_NB_NEIGHBORS-1; d<HHLattice::MAX_NB_NEIGHBORS; prev=d++) {
+        arcs += taken[d] && !taken[prev];
+        settledArcs += settled[d] && !settled[prev];
+    }
+    return arcs>1 || settledArcs>1;
+}
+
+bool MovableRobotBlockCode::lockedSteps() const {
+    // movers of the other regions walk at the same time
+    return concurrentMovers() || region;
+}
+
+//schedules the next step around the perimeter (in walkDirection); with concurrent movers the step
+//waits for the lock of every neighbor, and for a neighbor change while one of them holds this module
+void MovableRobotBlockCode::walkStep() {
+    blocked = false;
+    held = false;
+    Cell3DPosition destination;
+    HHLattice::Direction orient;
+
+    if (lockedSteps() && locks->lockClaimer!=0) {
+        blocked = true;
+        return;
+    }
+
+    if (!walkMotion(destination,orient)) {
+        if (lockedSteps()) resign();
+        return;
+    }
+    if (!lockedSteps()) {
+        scheduleMotion(destination,orient);
+        return;
+    }
+    if (locks->lockHolder!=0) {
+        blocked = true;
+        held = true;
+        return;
+    }
+    lockStep(destination);
+}
+
+void MovableRobotBlockCode::lockStep(const Cell3DPosition &destination) {
+    acquiring = true;
+    locks->stepAttempt++;
+    locks->lockDestination = destination;
+    locks->lockGranted = 0;
+    locks->lockWalkers = 0;
+    locks->lockReleased = 0;
+    locks->lockStuck = 0;
+    locks->lockPrior = 0;
+    locks->lockClaimer = 0;
+    lockSupported = false;
+    locks->lockPending = neighborMask();
+    sendToNeighbors("lock",new PairMessage(LOCK_MSG_ID,make_pair(destination[0],destination[1]),locks->stepAttempt));
+    if (locks->lockPending==0) stepGranted();
+}
+
+void MovableRobotBlockCode::stepGranted() {
+    acquiring = false;
+    Cell3DPosition destination;
+    HHLattice::Direction orient;
+    if (!lockSupported) {
+        // only movers border the destination, the mover would follow them away from the configuration
+        abortStep();
+        giveWay();
+        return;
+    }
+    // a neighbor may have moved since the lock was asked
+    if (!walkMotion(destination,orient) || destination!=locks->lockDestination) {
+        abortStep();
+        walkStep();
+    } else if (occupancy.isClaimed(destination)) {
+        // a mover out of reach of the modules held steps to the same cell, this one tries again when it arrives
+        abortStep();
+        blocked = true;
+    } else if (walkSteps==0 && (!removable() || !removable(locks->lockWalkers))) {
+        // the elected module holds its neighbors together, or those which do not walk: it stays
+        abortStep();
+        resign();
+    } else {
+        stepping = true;
+        // the refused neighbors try again when this module leaves them
+        locks->lockDenied = 0;
+        scheduleMotion(destination,orient);
+    }
+}
+
+void MovableRobotBlockCode::abortStep() {
+    acquiring = false;
+    for (int i=0; i<HHLattice::MAX_NB_NEIGHBORS; i++) {
+        P2PNetworkInterface *itf = interfaceAt(i);
+        if ((locks->lockGranted & (1<<i)) && itf->isConnected()) {
+            sendTo("unlock",new PairMessage(UNLOCK_MSG_ID,make_pair(0,0),locks->stepAttempt),itf);
+        }
+    }
+    locks->lockGranted = 0;
+    locks->lockPending = 0;
+    notifyDenied();
+}
+
+void MovableRobotBlockCode::neighborChanged() {
+    if (wakeOnChange) wakeLeader();
+    if (acquiring) {
+        // the locks were asked to the former neighbors
+        abortStep();
+        walkStep();
+    } else if (blocked) {
+        walkStep();
+    }
+}
+
+void MovableRobotBlockCode::releaseLock() {
+    releaseReserved();
+    locks->lockHolder = 0;
+    locks->lockIndex = -1;
+    lockKept = false;
+    notifyDenied();
+    if (wakeOnChange) wakeLeader();
+    if (moving && held) walkStep();
+}
+
+void MovableRobotBlockCode::releaseReserved() {
+    for (int i=0; i<HHLattice::MAX_NB_NEIGHBORS; i++) {
+        P2PNetworkInterface *itf = interfaceAt(i);
+        if ((locks->reserveGranted & (1<<i)) && itf->isConnected()) {
+            sendTo("unlock",new PairMessage(UNLOCK_MSG_ID,make_pair(1,0),locks->lockAttempt),itf);
+        }
+    }
+    locks->reservePending = 0;
+    locks->reserveGranted = 0;
+}
+
+void MovableRobotBlockCode::reserveAnswered(int index, bool granted) {
+    locks->reservePending &= ~(1<<index);
+    if (!granted) {
+        // a module next to the destination is held by another mover, which may step there too
+        int mover = locks->lockIndex;
+        if (interfaceAt(mover)->isConnected()) {
+            sendTo("grant",new PairMessage(GRANT_MSG_ID,make_pair(0,0),locks->lockAttempt),interfaceAt(mover));
+        }
+        bool released = locks->reserveReleased & (1<<index);
+        releaseLock();
+        // the mover is told when the module which refused is released
+        locks->lockDenied |= 1<<mover;
+        if (released) notifyDenied();
+        return;
+    }
+    locks->reserveGranted |= 1<<index;
+    if (locks->reservePending==0) {
+        sendTo("grant",new PairMessage(GRANT_MSG_ID,make_pair(1,1 | (moving ? 2 : 0) | stuckFlags()),locks->lockAttempt),interfaceAt(locks->lockIndex));
+    }
+}
+
+void MovableRobotBlockCode::notifyDenied() {
+    for (int i=0; i<HHLattice::MAX_NB_NEIGHBORS; i++) {
+        P2PNetworkInterface *itf = interfaceAt(i);
+        if ((locks->lockDenied & (1<<i)) && itf->isConnected()) sendTo("released",new PairMessage(RELEASED_MSG_ID),itf);
+    }
+    locks->lockDenied = 0;
+}
+
+void MovableRobotBlockCode::resign() {
+    moving = false;
+    locks->lockClaimer = 0;
+    noMotion = true;
+    if (concurrentMovers()) activeMovers--;
+    // a blocked mover of a region next to this one waits for it to leave: it stays, a support to step
+    // along now. Not with a single leader: its movers woken so crowd the pockets the others walk down
+    if (region) sendToNeighbors("released",new PairMessage(RELEASED_MSG_ID));
+    moverDone();
+}
+
+int MovableRobotBlockCode::stuckFlags() const {
+    if (!moving || !blocked) return 0;
+    return removable() ? 8 | 32 : 8;
+}
+
+void MovableRobotBlockCode::giveWay() {
+    // of movers blocked next to each other's destination, one which can leave its cell stops and holds
+    // the others (the lowest id of them), a stopped module which cannot would close a ring around a hole
+    uint8_t stuck = locks->lockStuck;
+    locks->lockStuck = 0;
+    if (locks->lockPrior!=0 && removable()) {
+        resign();
+        // it has a motion, it may be elected again, unless the movers it gave way to did not step either
+        noMotion = gaveWay;
+        gaveWay = true;
+    } else {
+        // those which give way to this one are told to try again
+        stuck &= ~locks->lockPrior;
+        blocked = true;
+    }
+    for (int i=0; i<HHLattice::MAX_NB_NEIGHBORS; i++) {
+        P2PNetworkInterface *itf = interfaceAt(i);
+        if ((stuck & (1<<i)) && itf->isConnected()) sendTo("released",new PairMessage(RELEASED_MSG_ID),itf);
+    }
+}
+
+void MovableRobotBlockCode::moverDone() {
+    // the rounds of other regions this module did not pass on may have found no module, their leaders
+    // wait for a WAKE
+    if (locks) {
+        for (Relay &r : locks->relays) {
+            if (r.missed) sendToNeighbors("relayWake",new PairMessage(WAKE_MSG_ID,make_pair(0,r.round),0,r.region));
+            r.missed = false;
+        }
+    }
+    if (isLeader || !concurrentMovers()) {
+        startWave();
+    } else {
+        // the parents of the last round lead to the module holding the election
+        locks->lastWake = currentRound;
+        sendToNeighbors("wake",new PairMessage(WAKE_MSG_ID,make_pair(0,currentRound)));
+    }
+}
+
+//a mover asks this module to stay in place during its step to the cell (x,y): granted when no other
+//mover holds it, it does not step itself and, walking, it has other neighbors; of two acquiring
+//neighbors, the one refused last time wins, else the highest id. Next to the destination, the module
+//first asks its neighbors next to it too (RESERVE, answered by GRANT like a LOCK)
+void MovableRobotBlockCode::lockFunc(std::shared_ptr<Message>_msg, P2PNetworkInterface*sender) {
+    PairMessage* msg = static_cast<PairMessage*>(_msg.get());
+    bID from = sender->getConnectedBlockId();
+    int i = interfaceIndex(sender);
+
+    if (msg->type==LOCK_MSG_ID && locks->lockHolder==from && !lockReserved && (int8_t)(msg->count-locks->lockAttempt)<0) {
+        // an older attempt of the holder, overtaken by the one this module is held for
+        return;
+    }
+    // a module next to the destination is where the mover arrives, it is held until then
+    Cell3DPosition destination(msg->data.first,msg->data.second,node()->position[2]);
+    HHLattice *lattice = static_cast<HHLattice*>(Hexanodes::getWorld()->lattice);
+    bool kept = false;
+    for (int d=0; d<HHLattice::MAX_NB_NEIGHBORS; d++) {
+        kept |= lattice->getCellInDirection(node()->position,d)==destination;
+    }
+
+    bool granted, contended = stepping || acquiring, alone = false;
+    if (stepping) {
+        granted = false;
+    } else if (neighborMask()==(1<<i) && msg->type==LOCK_MSG_ID) {
+        // a module hanging on the sender only would be left alone (the sender of a RESERVE stays)
+        granted = false;
+        alone = true;
+    } else if (acquiring) {
+        granted = from > node()->blockId || (i>=0 && (locks->lockYield & (1<<i)));
+        if (granted) {
+            abortStep();
+            blocked = true;
+            held = true;
+        }
+    } else if (kept && getScheduler()->now()<locks->arrivalGuard) {
+        // a step which started before this module arrived has not ended yet, the mover tries again then
+        granted = false;
+        sendTo("released",new PairMessage(RELEASED_MSG_ID),sender,locks->arrivalGuard-getScheduler()->now());
+    } else {
+        granted = locks->lockHolder==0 || locks->lockHolder==from;
+    }
+
+    if (i>=0 && contended) {
+        if (granted) locks->lockYield &= ~(1<<i);
+        else locks->lockYield |= 1<<i;
+    }
+    if (granted) {
+        releaseReserved();
+        locks->lockHolder = from;
+        locks->lockIndex = i;
+        locks->lockAttempt = msg->count;
+        lockKept = kept;
+        lockReserved = msg->type==RESERVE_MSG_ID;
+    } else if (i>=0) {
+        locks->lockDenied |= 1<<i;
+    }
+    if (granted && kept && msg->type==LOCK_MSG_ID) {
+        // the modules next to the destination on the other side are only reached through this one
+        locks->reserveReleased = 0;
+        for (int j=0; j<HHLattice::MAX_NB_NEIGHBORS; j++) {
+            if (j==i || !interfaceAt(j)->isConnected()) continue;
+            Cell3DPosition cell = lattice->getCellInDirection(node()->position,j);
+            for (int d=0; d<HHLattice::MAX_NB_NEIGHBORS; d++) {
+                if (lattice->getCellInDirection(destination,d)==cell) locks->reservePending |= 1<<j;
+            }
+            if (locks->reservePending & (1<<j)) {
+                sendTo("reserve",new PairMessage(RESERVE_MSG_ID,msg->data,msg->count),interfaceAt(j));
+            }
+        }
+        if (locks->reservePending!=0) return;
+    }
+    // second field: 1 when it holds the mover at its destination, 2 when it walks itself, 4 for a RESERVE,
+    // 8 when it walks but is blocked, 16 when it hangs on the mover only, 32 when it could give way, 64 when
+    // it steps to the same cell, 128 when it is blocked on the same cell
+    int same = destination!=locks->lockDestination ? 0 : stepping ? 64 : stuckFlags() ? 128 : 0;
+    sendTo("grant",new PairMessage(GRANT_MSG_ID,make_pair(granted,(kept ? 1 : 0) | (moving ? 2 : 0) | (msg->type==RESERVE_MSG_ID ? 4 : 0)
+                                   | (alone ? 16 : 0) | stuckFlags() | same),msg->count),sender);
+}
+
+void MovableRobotBlockCode::grantFunc(std::shared_ptr<Message>_msg, P2PNetworkInterface*sender) {
+    PairMessage* msg = static_cast<PairMessage*>(_msg.get());
+    int i = interfaceIndex(sender);
+    bool granted = msg->data.first;
+
+    if (msg->data.second & 4) {
+        // answer of a RESERVE of this module, its attempt is the one of the mover held
+        if (i>=0 && (locks->reservePending & (1<<i)) && msg->count==locks->lockAttempt) reserveAnswered(i,granted);
+        else if (granted) sendTo("unlock",new PairMessage(UNLOCK_MSG_ID,make_pair(1,0),msg->count),sender);
+        return;
+    }
+    if (!acquiring || msg->count!=locks->stepAttempt || i<0 || !(locks->lockPending & (1<<i))) {
+        // answer of a step given up meanwhile
+        if (granted) sendTo("unlock",new PairMessage(UNLOCK_MSG_ID,make_pair(0,0),msg->count),sender);
+        return;
+    }
+    locks->lockPending &= ~(1<<i);
+    if ((msg->data.second & 9)==9) {
+        locks->lockStuck |= 1<<i;
+        if (!(msg->data.second & 32) || sender->getConnectedBlockId() > (int)node()->blockId) locks->lockPrior |= 1<<i;
+    }
+    if (!granted) {
+        abortStep();
+        if ((msg->data.second & 18)==16) {
+            // a module which does not walk hangs on this mover only: the mover holds it and stays
+            resign();
+        } else if (locks->lockReleased & (1<<i)) {
+            walkStep();
+        } else {
+            // a neighbor stepping to the same cell: the mover waits for its arrival (UNLOCK), not for it to leave
+            if (msg->data.second & 64) locks->lockClaimer = sender->getConnectedBlockId();
+            blocked = true;
+        }
+        return;
+    }
+    locks->lockGranted |= 1<<i;
+    if (msg->data.second & 2) locks->lockWalkers |= 1<<i;
+    // a module which does not walk holds the mover at its destination
+    else lockSupported |= msg->data.second & 1;
+    if ((msg->data.second & (1|32|128))==(1|128) && !removable() && sender->getConnectedBlockId() < (int)node()->blockId) {
+        // two movers blocked on the same cell, neither can give way: the one which stays holds the other
+        lockSupported = true;
+    }
+    if (locks->lockPending==0) stepGranted();
+}
+
+void MovableRobotBlockCode::unlockFunc(std::shared_ptr<Message>_msg, P2PNetworkInterface*sender) {
+    PairMessage* msg = static_cast<PairMessage*>(_msg.get());
+    // the attempts of a RESERVE are the ones of another mover, the first field tells them apart
+    if (locks->lockHolder!=0 && locks->lockHolder==(bID)sender->getConnectedBlockId() && locks->lockAttempt==(uint8_t)msg->count
+        && lockReserved==(msg->data.first==1)) {
+        releaseLock();
+    }
+    if (locks->lockClaimer!=0 && locks->lockClaimer==(bID)sender->getConnectedBlockId()) {
+        locks->lockClaimer = 0;
+        if (moving && blocked) walkStep();
+    }
+}
+
+void MovableRobotBlockCode::releasedFunc(std::shared_ptr<Message>_msg, P2PNetworkInterface*sender) {
+    int i = interfaceIndex(sender);
+    // the refusal of the current step may still be on its way
+    if (acquiring && i>=0 && (locks->lockPending & (1<<i))) locks->lockReleased |= 1<<i;
+    else if (moving && blocked) walkStep();
+    // the refusal of a RESERVE may still be on its way
+    else if (i>=0 && (locks->reservePending & (1<<i))) locks->reserveReleased |= 1<<i;
+    // a module refused a RESERVE of this one, the movers refused meanwhile may try again
+    else if (locks->lockHolder==0) notifyDenied();
+    if (noMotion && gaveWay && !moving) {
+        // a mover this one gave way to stopped there, it may walk again
+        noMotion = false;
+        wakeLeader();
+    }
+}
+
+//climbs the parents of the last round up to the module holding the election, which starts a round
+//when it is idle; a module without parent passes it to all its neighbors, each module once per round.
+//With regions, the modules of the other regions pass it on like the rounds they relayed, and only a
+//leader waiting for its region starts a round
+void MovableRobotBlockCode::wakeFunc(std::shared_ptr<Message>_msg, P2PNetworkInterface*sender) {
+    PairMessage* msg = static_cast<PairMessage*>(_msg.get());
+
+    if (msg->region!=region) {
+        relayWake(msg,sender);
+        return;
+    }
+    if (isLeader) {
+        if (moving || finished) return;
+        if (waveOpen || nbWaitedAnswers>0) wakePending = true;
+        else if (regionWaiting) resumeRegion();
+        else if (!region && activeMovers < maxMovers) startWave();
+        return;
+    }
+    if (currentRound <= locks->lastWake) return;
+    locks->lastWake = currentRound;
+    if (parent()!=nullptr && parent()->isConnected()) {
+        sendTo("wake",new PairMessage(WAKE_MSG_ID,msg->data,0,region),parent());
+    } else {
+        sendToNeighbors("wake",new PairMessage(WAKE_MSG_ID,msg->data,0,region),sender);
+    }
+}
+
+void MovableRobotBlockCode::scheduleMotion(const Cell3DPosition &destination, HHLattice::Direction orientation) {
+    Time start = getScheduler()->now()+timing.motionStartDelay();
+    if (locks) locks->motionScheduled = getScheduler()->now();
+    motionOrigin = node()->position;
+    occupancy.claim(destination);
+    MovableRobotTrace::record(start,node()->blockId,TraceRecord::MOTION_START,0,destination[0],destination[1]);
+    if (!recordMotionsFile.empty() || !verifyMotionsFile.empty()) {
+        motionLog.motions.push_back(MotionLog::Motion{node()->blockId,node()->position,destination,orientation});
+    }
+    MovableRobotStats::motionsUnderWay++;
+    getScheduler()->schedule(new HexanodesMotionStartEvent(start, node(),destination,orientation));
+}
+
+
+
+bool MovableRobotBlockCode::walkMotion(Cell3DPosition &destination, HHLattice::Direction &orientation) {
+    MovableRobotStats::motionLookups++;
+    if (walkCacheHit(walkValid,walkPosition,walkOrientationCode,walkCachedDirection,
+                     node()->position,node()->orientationCode,walkDirection)) {
+        MovableRobotStats::motionCacheHits++;
+    } else {
+        vector<HexanodesMotion*> tab = Hexanodes::getWorld()->getAllMotionsForModule(node());
         auto ci=tab.begin();
+        motionDirection direction = walkDirection;
 
-        while (ci!=tab.end() && ((*ci)->direction!=motionDirection::CW)) {
+        while (ci!=tab.end() && ((*ci)->direction!=walkDirection)) {
             ci++;
         }
+        bool stuck = ci==tab.end();
+        if ((lockedSteps() || incrementalElection) && walkSteps>0 && (stuck || (*ci)->getFinalPos(node()->position)==motionOrigin)) {
+            // at a neck between two arcs of neighbors, the walk goes on around the other one rather than
+            // back to the cell it comes from, where it would come back again; in a pocket or at the edge
+            // of the world, with no other motion in its direction, the walk turns back
+            auto other = ci;
+            while (other!=tab.end() && (other==ci || (*other)->direction!=walkDirection)) other++;
+            if (other==tab.end()) {
+                other = tab.begin();
+                while (other!=tab.end() && ((*other)->direction==walkDirection
+                                            || (!stuck && (*other)->getFinalPos(node()->position)==motionOrigin))) other++;
+                if (other!=tab.end()) walkDirection = (*other)->direction;
+            }
+            if (other!=tab.end()) ci = other;
+        }
+        bool bounced = false;
+        if (region && walkSteps!=locks->walkTurn && (walkDirection!=direction
+                       || (walkSteps>0 && ci!=tab.end() && (*ci)->getFinalPos(node()->position)==motionOrigin))) {
+            // the walk turns back as far from the last turn as that one from the one before: it goes to and
+            // fro between two dead ends, a cavity or a stretch of the surface without free target cell (one
+            // turn per step, a blocked step looks its motion up again). The movers of a single leader keep
+            // to the lap rule: the pockets they go down are mostly walled in by the others for a while
+            bounced = walkSteps-locks->walkTurn==locks->walkTurnGap;
+            locks->walkTurnGap = locks->walkTurn<0 ? -1 : walkSteps-locks->walkTurn;
+            locks->walkTurn = walkSteps;
+        }
 
-        if (ci!=tab.end()) {
-            Cell3DPosition destination = (*ci)->getFinalPos(node->position);
-            auto orient = (*ci)->getFinalOrientation(node->orientationCode);
-            scheduler->schedule(new HexanodesMotionStartEvent(scheduler->now()+100000, node,destination,orient));
+        walkFound = ci!=tab.end() && !bounced;
+        if (walkFound) {
+            walkDestination = (*ci)->getFinalPos(node()->position);
+            walkOrientation = (*ci)->getFinalOrientation(node()->orientationCode);
+        } else {
+            walkDestination = Cell3DPosition();
         }
-   
+        walkValid = true;
+        walkPosition = node()->position;
+        walkOrientationCode = node()->orientationCode;
+        walkCachedDirection = walkDirection;
     }
+    destination = walkDestination;
+    orientation = walkOrientation;
+    return walkFound;
 }
 
+void MovableRobotBlockCode::startPlan() {
+    map<bID,Cell3DPosition> modules;
+    for (auto &b : BaseSimulator::getWorld()->buildingBlocksMap) {
+        modules[b.first] = b.second->position;
+    }
+    MovableRobotPlanner planner(static_cast<HHLattice*>(Hexanodes::getWorld()->lattice),
+                                [this](const Cell3DPosition &p) { return isInTarget(p); });
+    planner.shortest = shortestPath;
+    if (!planner.plan(modules,node()->blockId)) {
+        cerr << "planner: " << planner.error() << endl;
+    }
+    plan = planner.motions();
+    planCursor = 0;
+    MovableRobotStats::plannedMotions = plan.size();
+    MovableRobotStats::elections = planner.elections();
+    MovableRobotStats::ccwWalks = planner.ccwWalks();
+    console << "planner: " << plan.size() << " motions, " << planner.elections() << " movers" << "\n";
+
+    if (!planOnly) replayNextMotion();
+}
+
+void MovableRobotBlockCode::replayNextMotion() {
+    if (planCursor==plan.size()) return;
+    const MovableRobotPlanner::Motion &m = plan[planCursor++];
+    BuildingBlock *block = BaseSimulator::getWorld()->getBlockById(m.module);
+    MovableRobotBlockCode *code = block ? static_cast<MovableRobotBlockCode*>(block->blockCode) : nullptr;
+    if (code==nullptr || !code->startPlannedMotion(m)) {
+        cerr << "planner: motion " << planCursor-1 << " of module " << m.module << " from " << m.from
+             << " to " << m.to << " is not possible, the replay is stopped" << endl;
+        planCursor = plan.size();
+    }
+}
+
+bool MovableRobotBlockCode::startPlannedMotion(const MovableRobotPlanner::Motion &m) {
+    if (node()->position!=m.from) return false;
+    walkDirection = m.direction==MovableRobotPlanner::CCW ? motionDirection::CCW : motionDirection::CW;
+
+    Cell3DPosition destination;
+    HHLattice::Direction orient;
+    if (!walkMotion(destination,orient) || destination!=m.to) {
+        // the plan does not follow the first motion of the simulator, look for its step among the others
+        MovableRobotStats::planDivergences++;
+        vector<HexanodesMotion*> tab = Hexanodes::getWorld()->getAllMotionsForModule(node());
+        auto ci=tab.begin();
+        while (ci!=tab.end() && (*ci)->getFinalPos(node()->position)!=m.to) {
+            ci++;
+        }
+        if (ci==tab.end()) return false;
+        orient = (*ci)->getFinalOrientation(node()->orientationCode);
+    }
 
+    scheduleMotion(m.to,orient);
+    return true;
+}
 
 //Function is moving your robots just try its amazing
 void MovableRobotBlockCode::onMotionEnd() {
@@ -260,47 +1698,65 @@ void MovableRobotBlockCode::onMotionEnd() {
     
 
     nMotions++;
-
-    vector<HexanodesMotion*> tab = Hexanodes::getWorld()->getAllMotionsForModule(node);
-    
-    auto ci = tab.begin();
-    Cell3DPosition destination;
-
-    while (ci != tab.end() && ((*ci)->direction != motionDirection::CW)) {
-      ci++;
+    MovableRobotStats::motionsUnderWay--;
+    trace(TraceRecord::MOTION_END,0,node()->position[0],node()->position[1]);
+    MovableRobotStats::makespan = getScheduler()->now()+MovableRobotStats::timeOffset;
+    occupancy.move(motionOrigin,node()->position);
+    if (lockedSteps()) locks->arrivalGuard = 2*getScheduler()->now()-locks->motionScheduled;
+    if (stepping) {
+        // the neighbors held for the step are next to the module again
+        stepping = false;
+        locks->lockGranted = 0;
+        sendToNeighbors("unlock",new PairMessage(UNLOCK_MSG_ID,make_pair(0,0),locks->stepAttempt));
     }
+    if (!metricsFile.empty()) exportMetrics();
 
-   
-   
-    if (ci != tab.end()) {
-      destination = (*ci) -> getFinalPos(node->position);
+    if (plannerMode) {
+        replayNextMotion();
+        return;
     }
 
-    if ((target && target->isInTarget(node->position) && node->getNbNeighbors()>2) || (target&&target->isInTarget(node->position)&& !target->isInTarget(destination))) {
-            inPosition = true;
-
-        }
+    Cell3DPosition destination;
+    HHLattice::Direction orient;
+    walkMotion(destination,orient);
+    walkSteps++;
+    gaveWay = false;
 
-    if (inPosition){
+    if (isInTarget(node()->position) && (occupancy.nbNeighbors(node()->position)>2 || !isInTarget(destination))
+        && !(lockedSteps() && closesHole(node()->position))) {
+            inPosition = true;
 
-        distance=0;
-        currentRound++;
-        nbWaitedAnswers=sendMessageToAllNeighbors("distance(1,1)",new MessageOf<pair<int,int>>(BROADCAST_MSG_ID,make_pair(distance+1,currentRound)),1000,100,0);
-    } else{
-        vector<HexanodesMotion*> tab = Hexanodes::getWorld()->getAllMotionsForModule(node);
-        auto ci=tab.begin();
-        
-        while (ci!=tab.end() && ((*ci)->direction!=motionDirection::CW)) {
-            ci++;
         }
 
-        if (ci!=tab.end()) {
-            Cell3DPosition destination = (*ci)->getFinalPos(node->position);
-            auto orient = (*ci)->getFinalOrientation(node->orientationCode);
-            scheduler->schedule(new HexanodesMotionStartEvent(scheduler->now()+100000, node,destination,orient));
+    if (!inPosition && lockedSteps() && walkSteps > 12*(int)Hexanodes::getWorld()->maxBlockId+12 && removable()) {
+        // two laps without a cell: the walk goes round a pocket of stopped movers, the mover stops too, in
+        // the pocket rather than at its mouth where it would close a ring around it
+        resign();
+        return;
+    }
 
+    if (inPosition){
+        moving = false;
+        blocked = false;
+        held = false;
+        if (concurrentMovers()) activeMovers--;
+
+        if (incrementalElection && incrementalSettle) {
+            // join the persistent tree through the neighbors, the root is told to elect the next mover
+            // once this module is attached (SETTLED), no new round is flooded
+            incrementalSettle = false;
+            awaitingSettle = true;
+            distance = 0;
+            setParent(nullptr);
+            clearChildren();
+            sendToNeighbors("repairProbe",new PairMessage(REPAIR_MSG_ID,make_pair(0,currentRound)));
+            return;
         }
 
+        if (!checkpointFile.empty()) saveCheckpoint();
+        moverDone();
+    } else{
+        walkStep();
     }
 }
 
@@ -315,13 +1771,87 @@ string MovableRobotBlockCode::onInterfaceDraw() {
 
 
 
+void MovableRobotBlockCode::writeReport(const string &config, double wallClockMs) {
+    if (reportFile.empty()) return;
+
+    ofstream out(reportFile, ios::app);
+    if (!out) {
+        cerr << "cannot write report " << reportFile << endl;
+        return;
+    }
+    MovableRobotStats::writeReport(out, config, BaseSimulator::getWorld()->buildingBlocksMap.size(),
+                                   nMotions, getScheduler()->now()+MovableRobotStats::timeOffset, wallClockMs);
+}
+
+bool MovableRobotBlockCode::checkMotions() {
+    if (recordMotionsFile.empty() && verifyMotionsFile.empty()) return true;
+    for (auto &b : BaseSimulator::getWorld()->buildingBlocksMap) {
+        motionLog.finalPositions[b.first] = b.second->position;
+    }
+    bool ok = true;
+    if (!recordMotionsFile.empty() && !motionLog.save(recordMotionsFile)) {
+        cerr << "cannot write motions " << recordMotionsFile << endl;
+        ok = false;
+    }
+    if (!verifyMotionsFile.empty()) {
+        MotionLog reference;
+        if (!reference.load(verifyMotionsFile)) {
+            cerr << "cannot read motions " << verifyMotionsFile << endl;
+            return false;
+        }
+        if (!MotionLog::verify(reference,motionLog,cerr,verifyShapeOnly)) {
+            cerr << "motions differ from " << verifyMotionsFile << endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void MovableRobotBlockCode::exportMetrics(bool force) {
+    if (metricsFile.empty()) return;
+    auto now = chrono::steady_clock::now();
+    if (!force && now < metricsNext) return;
+    metricsNext = now + chrono::milliseconds(metricsPeriodMs);
+
+    size_t inPosition = 0;
+    int round = 0;
+    for (auto &b : BaseSimulator::getWorld()->buildingBlocksMap) {
+        MovableRobotBlockCode *code = static_cast<MovableRobotBlockCode*>(b.second->blockCode);
+        inPosition += code->inPosition;
+        if (b.first==currentLeader) round = code->currentRound;
+    }
+    // written aside then renamed, a reader never sees a partial file
+    string tmp = metricsFile + ".tmp";
+    {
+        ofstream out(tmp);
+        if (!out) {
+            cerr << "cannot write metrics " << tmp << endl;
+            metricsFile.clear();
+            return;
+        }
+        MovableRobotStats::writeMetrics(out, nMotions, getScheduler()->now()+MovableRobotStats::timeOffset,
+                                        currentLeader, round, inPosition, compactTargetLoaded ? compactTarget.size() : 0);
+    }
+    rename(tmp.c_str(), metricsFile.c_str());
+}
+
+void MovableRobotBlockCode::parseUserElements(TiXmlDocument *config) {
+    if (!compactTargetLoaded) {
+        compactTargetLoaded = compactTarget.load(config);
+    }
+    if (!timingLoaded) {
+        timing.load(config);
+        timingLoaded = true;
+    }
+}
+
 void MovableRobotBlockCode::parseUserBlockElements(TiXmlElement *config) {
     const char *attr = config->Attribute("leader");
     if (attr!=nullptr) {
         string str(attr);
         if (str=="true" || str=="1" || str=="yes") {
             isLeader=true;
-            std::cout << node->blockId << " is Leader!" << std::endl; // complete with your code
+            std::cout << node()->blockId << " is Leader!" << std::endl; // complete with your code
         }
     }
 }
@@ -337,11 +1867,41 @@ void MovableRobotBlockCode::processLocalEvent(EventPtr pev) {
     switch (pev->eventType) {
         case EVENT_ADD_NEIGHBOR: {
             // Do something when a neighbor is added to an interface of the module
+            walkValid = false;
+            noMotion = false;
+            neighborChanged();
             break;
         }
 
         case EVENT_REMOVE_NEIGHBOR: {
             // Do something when a neighbor is removed from an interface of the module
+            walkValid = false;
+            noMotion = false;
+            // a mover leaving its neighbors releases them, except the ones next to its destination
+            if (locks && locks->lockHolder!=0 && !lockKept && !interfaceAt(locks->lockIndex)->isConnected()) releaseLock();
+            neighborChanged();
+            answersLost();
+            if (incrementalElection && !moving) {
+                for (int i=0; i<HHLattice::MAX_NB_NEIGHBORS; i++) {
+                    if ((childMask & (1<<i)) && !node()->P2PNetworkInterfaces[i]->isConnected()) {
+                        childMask &= ~(1<<i);
+                        childBest[i] = make_pair(0,0);
+                        childCount[i] = 0;
+                    }
+                }
+                // the children told to leave the tree which left the module do not detach
+                uint8_t left = resetPending & ~neighborMask();
+                resetPending &= ~left;
+                if (resetBy>=0 && !interfaceAt(resetBy)->isConnected()) resetBy = -1;
+                if (left && resetPending==0) resetDone();
+                if (joining>=0 && !interfaceAt(joining)->isConnected()) {
+                    joining = -1;
+                    sendToNeighbors("repairProbe",new PairMessage(REPAIR_MSG_ID,make_pair(0,currentRound)));
+                }
+                if (parent()!=nullptr && !parent()->isConnected()) {
+                    resetSubtree(-1);
+                }
+            }
             break;
         }
     }
@@ -351,7 +1911,7 @@ void MovableRobotBlockCode::processLocalEvent(EventPtr pev) {
 
 void MovableRobotBlockCode::onBlockSelected() {
     // Debug stuff:
-    cerr << "\n" << "--- PRINT MODULE " << *node << "---" << "\n";
+    cerr << "\n" << "--- PRINT MODULE " << *node() << "---" << "\n";
 }
 
 void MovableRobotBlockCode::onAssertTriggered() {
@@ -361,6 +1921,22 @@ void MovableRobotBlockCode::onAssertTriggered() {
     // ...
 }
 
+// value of a "--name <integer>" option, consumed from the command line
+static int intArgument(const char *name, int &argc, char **argv[]) {
+    int value;
+    try {
+        if (argc < 2) throw std::invalid_argument(name);
+        value = stoi((*argv)[1]);
+    } catch(std::logic_error&) {
+        stringstream err;
+        err << name << " must be an integer. Found " << name << " = " << (argc < 2 ? "" : (*argv)[1]) << "\n";
+        throw CLIParsingError(err.str());
+    }
+    argc--;
+    (*argv)++;
+    return value;
+}
+
 bool MovableRobotBlockCode::parseUserCommandLineArgument(int &argc, char **argv[]) {
     /* Reading the command line */
     if ((argc > 0) && ((*argv)[0][0] == '-')) {
@@ -388,6 +1964,96 @@ bool MovableRobotBlockCode::parseUserCommandLineArgument(int &argc, char **argv[
                     }
 
                     console << "--foo option provided with value: " << fooArg << "\n";
+                } else if (varg == string("movers")) {
+                    maxMovers = intArgument("movers",argc,argv);
+                    console << "up to " << maxMovers << " concurrent movers" << "\n";
+                } else if (varg == string("message-delay")) {
+                    timing.messageDelay = intArgument("message-delay",argc,argv);
+                    timing.fromCommandLine |= TimingModel::MESSAGE_DELAY;
+                } else if (varg == string("message-jitter")) {
+                    timing.messageJitter = intArgument("message-jitter",argc,argv);
+                    timing.fromCommandLine |= TimingModel::MESSAGE_JITTER;
+                } else if (varg == string("jitter")) {
+                    if (argc < 2 || !TimingModel::parseJitter((*argv)[1],timing.jitter)) {
+                        throw CLIParsingError("--jitter requires none, uniform, normal or exponential\n");
+                    }
+                    timing.fromCommandLine |= TimingModel::JITTER;
+                    argc--;
+                    (*argv)++;
+                } else if (varg == string("motion-delay")) {
+                    timing.motionDelay = intArgument("motion-delay",argc,argv);
+                    timing.fromCommandLine |= TimingModel::MOTION_DELAY;
+                } else if (varg == string("timing-seed")) {
+                    timing.seed(intArgument("timing-seed",argc,argv));
+                    timing.fromCommandLine |= TimingModel::SEED;
+                } else if (varg == string("fast-forward")) {
+                    timing.fastForward = true;
+                    console << "fast-forward: messages and motions without delay" << "\n";
+                } else if (varg == string("leader-id")) {
+                    leaderId = intArgument("leader-id",argc,argv);
+                } else if (varg == string("report")) {
+                    if (argc < 2) throw CLIParsingError("--report requires a file name\n");
+                    reportFile = (*argv)[1];
+                    argc--;
+                    (*argv)++;
+                } else if (varg == string("trace")) {
+                    if (argc < 2) throw CLIParsingError("--trace requires a file name\n");
+                    if (!MovableRobotTrace::open((*argv)[1])) {
+                        throw CLIParsingError(string("cannot write trace ") + (*argv)[1] + "\n");
+                    }
+                    argc--;
+                    (*argv)++;
+                } else if (varg == string("planner")) {
+                    plannerMode = true;
+                    console << "planner: motions computed offline and replayed" << "\n";
+                } else if (varg == string("shortest")) {
+                    shortestPath = true;
+                    console << "planner: movers walk CW or CCW, whichever is shorter" << "\n";
+                } else if (varg == string("plan-only")) {
+                    plannerMode = true;
+                    planOnly = true;
+                } else if (varg == string("checkpoint")) {
+                    if (argc < 2) throw CLIParsingError("--checkpoint requires a file name\n");
+                    checkpointFile = (*argv)[1];
+                    argc--;
+                    (*argv)++;
+                } else if (varg == string("resume")) {
+                    // the snapshot is loaded by main, before the configuration is read
+                    if (argc < 2) throw CLIParsingError("--resume requires a file name\n");
+                    resumeFile = (*argv)[1];
+                    argc--;
+                    (*argv)++;
+                } else if (varg == string("record-motions")) {
+                    if (argc < 2) throw CLIParsingError("--record-motions requires a file name\n");
+                    recordMotionsFile = (*argv)[1];
+                    argc--;
+                    (*argv)++;
+                } else if (varg == string("verify-motions")) {
+                    if (argc < 2) throw CLIParsingError("--verify-motions requires a file name\n");
+                    verifyMotionsFile = (*argv)[1];
+                    argc--;
+                    (*argv)++;
+                } else if (varg == string("verify-shape")) {
+                    if (argc < 2) throw CLIParsingError("--verify-shape requires a file name\n");
+                    verifyMotionsFile = (*argv)[1];
+                    verifyShapeOnly = true;
+                    argc--;
+                    (*argv)++;
+                } else if (varg == string("metrics")) {
+                    if (argc < 2) throw CLIParsingError("--metrics requires a file name\n");
+                    metricsFile = (*argv)[1];
+                    argc--;
+                    (*argv)++;
+                } else if (varg == string("metrics-period")) {
+                    metricsPeriodMs = intArgument("metrics-period",argc,argv);
+                } else if (varg == string("regions")) {
+                    nbRegions = max(1,intArgument("regions",argc,argv));
+                } else if (varg == string("aggregate")) {
+                    aggregateAnswers = true;
+                    console << "aggregated election waves enabled" << "\n";
+                } else if (varg == string("incremental")) {
+                    incrementalElection = true;
+                    console << "incremental election enabled" << "\n";
                 } else return false;
 
                 return true;
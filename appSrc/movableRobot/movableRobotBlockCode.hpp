@@ -1,14 +1,24 @@
 #ifndef MovableRobotBlockCode_H_
 #define MovableRobotBlockCode_H_
 
+#include <chrono>
+
 #include "robots/hexanodes/hexanodesBlockCode.h"
 #include "robots/hexanodes/hexanodesSimulator.h"
 #include "robots/hexanodes/hexanodesBlock.h"
 #include "grid/lattice.h"
-static const int BROADCAST_MSG_ID = 1001;
-static const int ACKNOWLEDGE_MSG_ID = 1002;
-static const int NEXT_MSG_ID = 1003;
-static const int LEADER_FOUND_MSG_ID = 1004;
+
+#include "movableRobotMessages.hpp"
+#include "movableRobotElection.hpp"
+#include "movableRobotWalk.hpp"
+#include "movableRobotTarget.hpp"
+#include "movableRobotTiming.hpp"
+#include "movableRobotTrace.hpp"
+#include "movableRobotPlanner.hpp"
+#include "movableRobotCheckpoint.hpp"
+#include "movableRobotOccupancy.hpp"
+#include "movableRobotMotionLog.hpp"
+#include "movableRobotRegions.hpp"
 
 
 using namespace Hexanodes;
@@ -16,25 +26,411 @@ using namespace Hexanodes;
 class MovableRobotBlockCode : public HexanodesBlockCode {
 private:
 
-    bool isLeader=false;
-	bool inPosition = false;
+	// the fields are grouped by size and the flags packed into bits: with 100k+ modules the state
+	// of the block codes is a large part of the heap (blockCodeBytes and heapPerModule in the report)
 	int distance=0;
 	int currentRound=0;
-	int nbWaitedAnswers=0;
 	int NextFromLeader = 0;
 	int distanceOfNext =0;
-	int target_row = 0;
 
-    HexanodesWorld *wrl ;
-    P2PNetworkInterface *parent= nullptr;
+	// incremental election: persistent spanning tree and best candidate of each child subtree
+	pair<int,int> childBest[HHLattice::MAX_NB_NEIGHBORS];
+	// modules in position of each child subtree (incremental) and of the subtree in the current wave (flood)
+	int childCount[HHLattice::MAX_NB_NEIGHBORS] = {};
+	int waveCount = 0;
+	// motions of the current walk
+	int walkSteps = 0;
+	// leader of the region of the module, 0 when there is a single leader
+	bID region = 0;
+
+	// direction of the walk of the module along the surface (CW, or the direction of the plan when replayed)
+	motionDirection walkDirection = motionDirection::CW;
+	// motion in walkDirection available from walkPosition/walkOrientationCode, valid until a neighbor changes
+	motionDirection walkCachedDirection = motionDirection::CW;
+	HHLattice::Direction walkOrientation = HHLattice::EAST;
+	Cell3DPosition walkPosition;
+	Cell3DPosition walkDestination;
+	// cell the module leaves with its scheduled motion, for the occupancy index
+	Cell3DPosition motionOrigin;
+	// incremental election: date at which the last message of the module leaves, see inOrder
+	Time lastSendDate = 0;
+
+	// waves of the other regions forwarded by this module (--regions), see relayWave
+	struct Relay {
+		bID region;
+		int round;
+		pair<int,int> best;
+		int count;
+		int8_t parentIndex;
+		// sender of the last round relayed, where a WAKE of the region goes, and the round of the last one
+		int8_t treeIndex;
+		int woken;
+		int8_t nbWaitedAnswers;
+		uint8_t pendingMask;
+		bool election;  // BROADCAST answered by NEXT, else LEADER_FOUND answered by ACKNOWLEDGE
+		bool missed;    // a round answered without relay while walking, woken again once the walk ends
+	};
+
+	// state of the locked steps of concurrent movers and regions, allocated by startup() in these modes
+	// only (--movers, --regions): the block code of the other modes is smaller by its size
+	struct LockState {
+		// when the motion was scheduled; until arrivalGuard, a module which has just arrived is not kept
+		// by a mover: another one may still be on its way to a cell next to it, locked before it came
+		Time motionScheduled = 0;
+		Time arrivalGuard = 0;
+		// destination of the step whose neighbors are asked for a lock
+		Cell3DPosition lockDestination;
+		// mover whose step holds this module in place (0 if none), its interface and attempt,
+		// and the interfaces of the movers refused meanwhile, told when the lock is released
+		bID lockHolder = 0;
+		int8_t lockIndex = -1;
+		uint8_t lockAttempt = 0;
+		uint8_t lockDenied = 0;
+		// lock next to the destination: the neighbors next to it too, asked to hold (not answered yet) and holding,
+		// and the ones whose RELEASED came before their refusal, the mover then tries again at once
+		uint8_t reservePending = 0;
+		uint8_t reserveGranted = 0;
+		uint8_t reserveReleased = 0;
+		// movers refused by this mover for its own step, they win the next conflict with it
+		uint8_t lockYield = 0;
+		// mover: attempt of its current step, neighbors which have not answered it, which granted it
+		// and which walk themselves (they do not hold the configuration together)
+		uint8_t stepAttempt = 0;
+		uint8_t lockPending = 0;
+		uint8_t lockGranted = 0;
+		uint8_t lockWalkers = 0;
+		// neighbors whose RELEASED came before their refusal of the step, which is then tried again
+		uint8_t lockReleased = 0;
+		// walking neighbors which answered the step while blocked themselves, they may wait for this mover
+		uint8_t lockStuck = 0;
+		// those of them this mover gives way to: they cannot leave their cell, or have a higher id
+		uint8_t lockPrior = 0;
+		// neighbor which refused the step as it steps to the same cell, the mover tries again when it arrives
+		bID lockClaimer = 0;
+		// last round for which a WAKE was forwarded
+		int lastWake = 0;
+		// step of the last turn back of the walk and motions since the one before, -1 before the first ones
+		int walkTurn = -1;
+		int walkTurnGap = -1;
+		// one per region whose waves the module forwarded
+		vector<Relay> relays;
+	};
+	std::unique_ptr<LockState> locks;
+
+	uint8_t walkOrientationCode = 0;
+	uint8_t childMask = 0;
+	// incremental election: children told to leave the tree whose detach has not come yet, and the
+	// interface of the module which reset this one, told once they all left (-1 when the parent left)
+	uint8_t resetPending = 0;
+	int8_t resetBy = -1;
+	// incremental election: interface of the neighbor asked to be the parent, which confirms it while
+	// still in the tree (a detached module attaches to no offer sent before its sender was reset)
+	int8_t joining = -1;
+	// interfaces whose answer to the current wave has not come yet, a neighbor which leaves
+	// counts as answered (REMOVE_NEIGHBOR)
+	uint8_t pendingMask = 0;
+	int8_t nbWaitedAnswers=0;
+	// interface of the parent in the spanning tree, and of the child whose report holds the
+	// candidate of the current round (--aggregate), -1 when none
+	int8_t parentIndex = -1;
+	int8_t bestChildIndex = -1;
+
+	// initialized by the constructor, bit-fields have no default member initializer in C++17
+	bool isLeader : 1;
+	bool inPosition : 1;
+	bool moving : 1;
+	bool treeRoot : 1;
+	bool incrementalSettle : 1;
+	bool awaitingSettle : 1;
+	// tree root: no module out of position was attached when the last mover settled, the next report of
+	// one elects it
+	bool dispatchWaiting : 1;
+	bool waveOpen : 1;
+	// concurrent movers: waiting for a neighbor change, or for the release of the lock of another
+	// mover when held; root refills the movers
+	bool blocked : 1;
+	bool held : 1;
+	bool rewaveOnAck : 1;
+	// the neighbors of the mover are asked for a lock, the motion of the granted step is scheduled
+	bool acquiring : 1;
+	bool stepping : 1;
+	// a neighbor which does not walk borders the destination of the step
+	bool lockSupported : 1;
+	// the lock held by this module stays until the mover arrives next to it (it borders the destination)
+	bool lockKept : 1;
+	// the lock was asked by a RESERVE, its attempt is the one of the mover of the sender
+	bool lockReserved : 1;
+	// the module found no motion as a mover, it is not a candidate until a neighbor changes
+	bool noMotion : 1;
+	// the mover gave way since its last step, it is not a candidate again after a second time
+	bool gaveWay : 1;
+	// election root of the concurrent movers: a mover settled during the round, no mover walked at its start
+	bool wakePending : 1;
+	bool quietRound : 1;
+	bool walkValid : 1;
+	bool walkFound : 1;
+	// elected while it relays a wave of another region, the walk starts once the relay is closed
+	bool holdMotion : 1;
+	// --regions: the last round of the region found no candidate, its leader waits for a WAKE; the module
+	// could not leave at the last round, it wakes its leader when its neighbors change or it is released
+	bool regionWaiting : 1;
+	bool wakeOnChange : 1;
+
+    P2PNetworkInterface *parent() const { return interfaceAt(parentIndex); }
+    void setParent(P2PNetworkInterface *itf) { parentIndex = interfaceIndex(itf); }
+    P2PNetworkInterface *bestChild() const { return interfaceAt(bestChildIndex); }
+    void setBestChild(P2PNetworkInterface *itf) { bestChildIndex = interfaceIndex(itf); }
+    P2PNetworkInterface *interfaceAt(int index) const {
+        return index<0 ? nullptr : node()->P2PNetworkInterfaces[index];
+    }
+
+    /// sends a message (counted by type for the report) to one interface or to all neighbors but except
+    int sendTo(const char *name, Message *msg, P2PNetworkInterface *dest, Time after=0);
+    int sendToNeighbors(const char *name, Message *msg, P2PNetworkInterface *except=nullptr);
+    /**
+     * @brief Latency of a message sent now with the given one, in incremental mode no message of the
+     *  module leaves before the previous one: the messages of a link arrive in the order they were sent,
+     *  which the repairs of the tree rely on (a detach never overtakes the report before it)
+     */
+    Time inOrder(Time delay);
+
+    /// records an event of this module in the trace (--trace), at the current date
+    void trace(uint16_t kind, uint16_t msgType=0, int32_t a=0, int32_t b=0) const;
+    typedef void (MovableRobotBlockCode::*MessageHandler)(std::shared_ptr<Message>, P2PNetworkInterface*);
+    // handler of each message type, shared by all the modules
+    static const MessageHandler handlers[NB_MSG_TYPES];
+    /// handler registered for every message type: records the reception in the trace and calls the
+    ///  handler of the type from the shared table, it only captures this and needs no heap allocation
+    eventFunc2 traced();
+    /// registers traced() for the message types of the mode of the run only: the simulator keeps one
+    ///  std::function per type and module
+    void registerHandlers();
+
+    /// lookup in the shared compact target, or in the simulator target when none could be loaded
+    bool isInTarget(const Cell3DPosition &p) const;
+    /// the region has no module left to move, or none can leave until a WAKE: the run ends with the last
+    ///  active region
+    void endRegion();
+    /// a leader waiting for its region starts a new round
+    void resumeRegion();
+    /// a module which could not leave at the last round tells the leader of its region that it may now
+    void wakeLeader();
+    /// a module of a region or a concurrent mover can be elected: its neighbors stay connected without
+    ///  it (neighbors of other regions included, they relay the rounds of its region)
+    bool canLeave() const;
+    /// settled in p, the module would wall in free cells: cells of the target the movers no longer reach, or
+    ///  a ring of modules to leave around cells out of it (concurrent movers and regions fill the target in
+    ///  no fixed order); holes of the target itself are closed
+    bool closesHole(const Cell3DPosition &p) const;
+    /// the connected interfaces but the ignored ones form a single arc: these neighbors stay connected
+    ///  without the module
+    bool removable(uint8_t ignored=0) const;
+
+    int interfaceIndex(P2PNetworkInterface *itf) const;
+    /// mask of the connected interfaces but except
+    uint8_t neighborMask(P2PNetworkInterface *except=nullptr) const;
+    /// floods msg to the neighbors but except and waits for the answer of each of them
+    void sendWave(const char *name, PairMessage *msg, P2PNetworkInterface *except=nullptr);
+    /// the answer of sender to the current wave, false if it is not waited for (late or repeated)
+    bool answered(P2PNetworkInterface *sender);
+    /// the LEADER_FOUND flood of the module is acknowledged by all its neighbors
+    void acknowledged();
+    /// neighbors which left before answering a wave of the module count as answered
+    void answersLost();
+    /**
+     * @brief BROADCAST or LEADER_FOUND of another region: forwarded as a relay on a newer round of
+     *  that region, answered otherwise. The relay waits for the answers of its neighbors and sends
+     *  their best candidate and count to the sender; it is neither a candidate nor counted itself,
+     *  so that a region stays connected when its modules settle next to modules of other regions.
+     */
+    void relayWave(PairMessage *msg, P2PNetworkInterface *sender);
+    /// WAKE of another region, sent toward the sender of the last round relayed for it
+    void relayWake(PairMessage *msg, P2PNetworkInterface *sender);
+    /// NEXT or ACKNOWLEDGE of a wave relayed for another region
+    void relayAnswer(PairMessage *msg, P2PNetworkInterface *sender);
+    /// all the neighbors have answered the relayed wave: reports to the relay parent
+    void relayAnswered(Relay &r);
+    Relay &relayOf(bID region);
+    bool relaying() const;
+    /// best (id,distance) candidate among this module and its child subtrees, (0,0) when none
+    pair<int,int> subtreeBest() const;
+    /// number of modules in position in this module and its child subtrees
+    int subtreeCount() const;
+    /// SUBTREE or SETTLED report of the subtree for the parent
+    Message *subtreeReport(int type) const;
+    /// true when count modules in position fill the whole target
+    static bool targetComplete(int count);
+    /// prints the final metrics and ends the simulation
+    void finish(bool complete);
+    void clearChildren();
+    /// selection of module id as the mover of the given round, routed down the tree
+    void routeDispatch(int id, int round);
+    void startMoving(int round);
+    /**
+     * @brief The module leaves the tree with its subtree, by the interface of the module which reset it
+     *  (-1 when its parent left): it tells its children to leave first and looks for a new parent once
+     *  all of them did, so that it cannot attach below one of its former descendants
+     */
+    void resetSubtree(int by);
+    /// the children of a reset module have left the tree: it acknowledges the reset and probes its neighbors
+    void resetDone();
+
+    /// indexes the cells of all the modules and computes the regions, on the first startup
+    static void buildOccupancy();
+    static bool concurrentMovers();
+    /// concurrent movers or regions: the modules hold a LockState and handle the messages of the locks
+    static bool locksUsed();
+    /// echo wave with crossing broadcasts as answers and routed selection (--aggregate, one mover, flood mode)
+    static bool aggregatedWave();
+    void echoBroadcast(const pair<int,int> &msgData, P2PNetworkInterface *sender);
+    /// closes the round of the module once every neighbor has answered
+    void waveAnswered();
+    /// the module walks from the given round, it leads the next round if it holds the election
+    void becomeMover(int round, bool leads);
+    void routeMover(int id, int round);
+    /// the module floods a new election round from its position
+    void startWave();
+    /// writes the state of all the modules to checkpointFile, when no message is in flight
+    void saveCheckpoint();
+    /// state of the module in the snapshot the run is resumed from
+    void restoreState();
+    void nextRound();
+    /// the steps of the movers are locked with their neighbors (--movers, --regions)
+    bool lockedSteps() const;
+    void walkStep();
+    /// asks every neighbor to stay in place during the step to destination
+    void lockStep(const Cell3DPosition &destination);
+    /// all the neighbors granted the step: its motion is scheduled if it is still the same
+    void stepGranted();
+    /// the step is given up: the granted locks are released and the refused movers told
+    void abortStep();
+    void releaseLock();
+    /// the neighbors held for the lock of this module are released
+    void releaseReserved();
+    /// GRANT of a neighbor asked to hold for the lock of this module, the mover is answered after the last one
+    void reserveAnswered(int index, bool granted);
+    /// a blocked mover tries its step again, an acquiring one asks its new neighbors
+    void neighborChanged();
+    /// the neighbors refused while the module was held or acquiring may try again
+    void notifyDenied();
+    /// the mover has no motion: it stops walking and the election goes on without it
+    void resign();
+    /// grant flags of a blocked mover: 8, and 32 when it could give way
+    int stuckFlags() const;
+    /// the step failed next to blocked movers (lockStuck): the mover stops so that they can step next to it,
+    /// or waits for one of them to stop
+    void giveWay();
+    /// a mover settled or resigned: the next round is started, by this module if it holds the election
+    void moverDone();
+    /// schedules the motion of the module to destination, recorded in the trace and the motion log
+    void scheduleMotion(const Cell3DPosition &destination, HHLattice::Direction orientation);
+    /// motion of the module in walkDirection (from the cache when the neighborhood did not change), false if none
+    bool walkMotion(Cell3DPosition &destination, HHLattice::Direction &orientation);
+
+    /// computes the plan of the reconfiguration from the current positions (planner mode)
+    void startPlan();
+    /// schedules the next motion of the plan, on the module it belongs to
+    static void replayNextMotion();
+    bool startPlannedMotion(const MovableRobotPlanner::Motion &m);
 
 
 
 
 public :
-    Scheduler *scheduler;
-    Hexanodes::HexanodesBlock *node;
+    /// module of the block code, the scheduler and the world are reached through their singletons
+    Hexanodes::HexanodesBlock *node() const { return static_cast<Hexanodes::HexanodesBlock*>(hostBlock); }
     inline static size_t nMotions = 0;
+    // repair the spanning tree locally after each motion instead of flooding a new round
+    inline static bool incrementalElection = false;
+    // several modules walk the perimeter at the same time, each step is locked with the neighbors of the mover
+    inline static int maxMovers = 1;
+    inline static int activeMovers = 0;
+    // crossing broadcasts count as answers and the mover is reached along the reports,
+    // instead of the NEXT reply on every edge and the acknowledged LEADER_FOUND flood (--aggregate)
+    inline static bool aggregateAnswers = false;
+    inline static bool finished = false;
+    // target of the configuration, loaded once for all the modules
+    inline static CompactTarget compactTarget;
+    inline static bool compactTargetLoaded = false;
+    // neither the compact target nor the target of the simulator could be read, nothing moves
+    inline static bool targetMissing = false;
+    // --leader-id is not a module of the world, nothing moves
+    inline static bool leaderMissing = false;
+    // cells occupied by the modules, updated at every motion end
+    inline static OccupancyIndex occupancy;
+    inline static bool occupancyBuilt = false;
+    // one region per leader, each one elects and moves its modules until it fills its slice of the target (--regions <n>)
+    inline static size_t nbRegions = 1;
+    inline static RegionMap regions;
+    inline static int activeRegions = 0;
+    // latency of the messages and delay before each motion (<timing> element and command line)
+    inline static TimingModel timing;
+    inline static bool timingLoaded = false;
+    // the motions are computed offline by MovableRobotPlanner and replayed without messages
+    // (--planner), or only computed (--plan-only)
+    inline static bool plannerMode = false;
+    // with --planner, each mover walks CW or CCW, whichever is shorter on the current surface (--shortest)
+    inline static bool shortestPath = false;
+    inline static bool planOnly = false;
+    inline static vector<MovableRobotPlanner::Motion> plan;
+    inline static size_t planCursor = 0;
+    // snapshot written at each settle point (--checkpoint <file>) and snapshot the run started from
+    inline static string checkpointFile;
+    inline static MovableRobotCheckpoint resumed;
+    inline static bool resuming = false;
+    // snapshot given with --resume <file>, loaded by main
+    inline static string resumeFile;
+    // leader replacing the one of the configuration when >=0 (--leader-id)
+    inline static int leaderId = -1;
+    // JSON report written at the end of the run (--report <file>)
+    inline static string reportFile;
+    // Prometheus text metrics rewritten every metricsPeriodMs of host time (--metrics <file>, --metrics-period <ms>),
+    // the period is checked at each motion end and every 1024 messages
+    inline static string metricsFile;
+    inline static int metricsPeriodMs = 1000;
+    inline static std::chrono::steady_clock::time_point metricsNext;
+    // module which flooded the last round or is moving
+    inline static bID currentLeader = 0;
+    // motions of the run, written to (--record-motions <file>) or compared with (--verify-motions <file>) a reference,
+    // --verify-shape <file> only compares the final shape (modes electing the movers in another order)
+    inline static string recordMotionsFile;
+    inline static string verifyMotionsFile;
+    inline static bool verifyShapeOnly = false;
+    inline static MotionLog motionLog;
+
+    /**
+     * @brief Appends the report of the run to reportFile, if any
+     * @param config configuration file of the run
+     * @param wallClockMs host time of the run in milliseconds
+     * @note call is made from main once the simulation has ended
+     */
+    static void writeReport(const string &config, double wallClockMs);
+
+    /**
+     * @brief Rewrites metricsFile, if any, when the metrics period has elapsed
+     * @param force writes the file whatever the time of the last write (end of the run)
+     */
+    static void exportMetrics(bool force = false);
+
+    /**
+     * @brief Writes the motion log of the run (--record-motions) and compares it with the reference (--verify-motions)
+     * @return false if the log cannot be written or read, or if the run differs from the reference
+     *  by its final shape or, unless verifyShapeOnly, by more motions
+     * @note call is made from main once the simulation has ended
+     */
+    static bool checkMotions();
+
+    /**
+     * @brief Loads a snapshot (--resume <file>) and writes the configuration to start from
+     * @param snapshot snapshot file written by --checkpoint
+     * @param config configuration of the run, replaced by the configuration of the snapshot
+     * @return false if the snapshot or the configuration cannot be read
+     * @note call is made from main before the simulator is created
+     */
+    static bool resume(const string &snapshot, string &config);
+
+    /// true when the options do not fit the world (--leader-id of no module), the run did nothing
+    static bool invalidParameters() { return leaderMissing; }
 
 
 
@@ -73,7 +469,7 @@ public :
      *
      * Called from BuildingBlock constructor, only once.
      */
-    void parseUserElements(TiXmlDocument *config) override {}
+    void parseUserElements(TiXmlDocument *config) override;
 
     /**
      * @brief Provides the user with a pointer to the configuration file parser, which can be used to read additional user information from each block config. Has to be overriden in the child class.
@@ -139,6 +535,28 @@ public :
 
     void myBroadcastFunc(std::shared_ptr<Message>_msg,P2PNetworkInterface *sender);
 
+    /**
+     * @brief Incremental election handlers: subtree candidate reports (SUBTREE/SETTLED),
+     *  distance offers used to attach and relax the tree (REPAIR), orphaned subtree reset (RESET)
+     *  and mover selection routed down the tree (DISPATCH)
+     */
+    void subtreeFunc(std::shared_ptr<Message>_msg,P2PNetworkInterface *sender);
+    void repairFunc(std::shared_ptr<Message>_msg,P2PNetworkInterface *sender);
+    void resetFunc(std::shared_ptr<Message>_msg,P2PNetworkInterface *sender);
+    void dispatchFunc(std::shared_ptr<Message>_msg,P2PNetworkInterface *sender);
+
+    /**
+     * @brief Steps of concurrent movers: a mover asks its neighbors to stay in place (LOCK) and moves
+     *  once all of them granted it (GRANT), releases them after the motion (UNLOCK), and refused
+     *  movers try again when the lock is released (RELEASED). A settled mover asks the module holding
+     *  the election for a new round (WAKE), along the parents of the last round.
+     */
+    void lockFunc(std::shared_ptr<Message>_msg,P2PNetworkInterface *sender);
+    void grantFunc(std::shared_ptr<Message>_msg,P2PNetworkInterface *sender);
+    void unlockFunc(std::shared_ptr<Message>_msg,P2PNetworkInterface *sender);
+    void releasedFunc(std::shared_ptr<Message>_msg,P2PNetworkInterface *sender);
+    void wakeFunc(std::shared_ptr<Message>_msg,P2PNetworkInterface *sender);
+
     
 
 
@@ -0,0 +1,67 @@
+/**
+ * @file   movableRobotCheckpoint.cpp
+ * @brief  Snapshot file and resumed configuration of a movableRobot run
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include "deps/TinyXML/tinyxml.h"
+#include "movableRobotCheckpoint.hpp"
+
+using namespace std;
+
+static const char SNAPSHOT_MAGIC[8] = {'M','R','S','N','A','P','0','1'};
+
+bool MovableRobotCheckpoint::save(const string &file) const {
+    // written aside then renamed, a crash during the write keeps the previous snapshot
+    string tmp = file + ".tmp";
+    FILE *out = fopen(tmp.c_str(),"wb");
+    if (!out) return false;
+    Header h = header;
+    h.nbMessageTypes = messages.size();
+    h.nbModules = modules.size();
+    bool ok = fwrite(SNAPSHOT_MAGIC,sizeof(SNAPSHOT_MAGIC),1,out)==1
+        && fwrite(&h,sizeof(h),1,out)==1
+        && fwrite(messages.data(),sizeof(uint64_t),messages.size(),out)==messages.size()
+        && fwrite(modules.data(),sizeof(ModuleState),modules.size(),out)==modules.size();
+    ok = (fclose(out)==0) && ok;
+    return ok && rename(tmp.c_str(),file.c_str())==0;
+}
+
+bool MovableRobotCheckpoint::load(const string &file) {
+    FILE *in = fopen(file.c_str(),"rb");
+    if (!in) return false;
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    bool ok = fread(magic,sizeof(magic),1,in)==1 && memcmp(magic,SNAPSHOT_MAGIC,sizeof(magic))==0
+        && fread(&header,sizeof(header),1,in)==1;
+    if (ok) {
+        messages.resize(header.nbMessageTypes);
+        modules.resize(header.nbModules);
+        ok = fread(messages.data(),sizeof(uint64_t),messages.size(),in)==messages.size()
+            && fread(modules.data(),sizeof(ModuleState),modules.size(),in)==modules.size();
+    }
+    fclose(in);
+    return ok;
+}
+
+bool MovableRobotCheckpoint::writeConfig(const string &config, const string &out) const {
+    TiXmlDocument doc(config.c_str());
+    if (!doc.LoadFile()) return false;
+    TiXmlNode *world = doc.FirstChild("world");
+    TiXmlNode *blockList = world ? world->FirstChild("blockList") : nullptr;
+    if (!blockList) return false;
+
+    // the csg and block entries are replaced by the modules of the snapshot
+    blockList->Clear();
+    char buf[64];
+    for (const ModuleState &m : modules) {
+        TiXmlElement block("block");
+        snprintf(buf,sizeof(buf),"%d,%d,%d",m.x,m.y,m.z);
+        block.SetAttribute("position",buf);
+        block.SetAttribute("orientation",m.orientationCode);
+        if (m.blockId==header.leader) block.SetAttribute("leader","true");
+        blockList->InsertEndChild(block);
+    }
+    return doc.SaveFile(out.c_str());
+}
@@ -0,0 +1,66 @@
+#ifndef MovableRobotCheckpoint_H_
+#define MovableRobotCheckpoint_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Snapshot of a movableRobot reconfiguration (--checkpoint <file>, --resume <file>).
+ *
+ * Snapshots are taken when a mover settles, before it floods the next election round: no
+ *  message is in flight and no motion is scheduled at that time, so the state of the run is
+ *  the state of the modules plus the run counters, and the only pending event is the wave
+ *  of the new leader, which is started again on resume.
+ *
+ * The events pending in the scheduler are not part of the snapshot: a settle point with a
+ *  message still in flight is skipped, snapshots are only taken at quiescent points. Only the
+ *  flooded election with a single mover and a single region has such points; with --incremental,
+ *  --movers, --planner or several regions, --checkpoint is ignored with a warning.
+ *
+ * File format (host endianness): the 8 bytes magic "MRSNAP01", a Header, then one
+ *  ModuleState per module in block id order.
+ */
+class MovableRobotCheckpoint {
+public:
+    struct ModuleState {
+        uint32_t blockId;
+        int16_t x, y, z;
+        uint8_t orientationCode;
+        uint8_t flags;           // IN_POSITION | IS_LEADER
+        int32_t distance;
+        int32_t currentRound;
+        int32_t nextFromLeader;
+        int32_t distanceOfNext;
+        int8_t parent;           // interface of the parent, -1 if none
+        uint8_t pad[3];
+    };
+    enum { IN_POSITION=1, IS_LEADER=2 };
+
+    struct Header {
+        uint64_t date;           // simulated date of the snapshot
+        uint64_t motions;
+        uint64_t rounds, elections, messagesReceived;
+        uint64_t motionLookups, motionCacheHits;
+        uint32_t leader;         // module flooding the next round
+        int32_t unused;          // always 0, keeps the layout of the snapshot files
+        uint32_t nbMessageTypes;
+        uint32_t nbModules;
+    };
+
+    Header header = {};
+    std::vector<uint64_t> messages;  // sent messages by type
+    std::vector<ModuleState> modules;
+
+    bool save(const std::string &file) const;
+    bool load(const std::string &file);
+
+    /**
+     * @brief Writes a copy of a configuration file whose <blockList> holds the modules of the
+     *  snapshot, in block id order so that they get the same ids, with the leader of the next round
+     * @return false if the configuration cannot be read or the copy cannot be written
+     */
+    bool writeConfig(const std::string &config, const std::string &out) const;
+};
+
+#endif /* MovableRobotCheckpoint_H_ */
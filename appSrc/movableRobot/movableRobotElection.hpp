@@ -0,0 +1,32 @@
+#ifndef MovableRobotElection_H_
+#define MovableRobotElection_H_
+
+#include <utility>
+
+/**
+ * @brief Rules of the election rounds, shared by the message handlers of the block code and
+ *  by the microbenchmarks (movableRobotMicroBench.cpp).
+ *
+ * A candidate is an (id,distance) pair: the next mover is the module farthest from the leader
+ *  which is not in position, the highest id among the farthest ones. A BROADCAST carries the
+ *  (distance,round) of the module which receives it.
+ */
+
+/// true when candidate c is elected before best
+inline bool isBetterCandidate(const std::pair<int,int> &c, const std::pair<int,int> &best) {
+    return c.second > best.second || (c.second == best.second && c.first > best.first);
+}
+
+/**
+ * @brief A BROADCAST makes its sender the parent of the module and is flooded further when
+ *  it opens a newer round. The parent is kept until the end of the round, as in an echo wave:
+ *  a later BROADCAST of the round is answered even when it gives a shorter path, so that each
+ *  module reports its subtree once, to its final parent, and the counts of the reports add up.
+ * @param broadcast (distance,round) of the message
+ * @param round current round of the module
+ */
+inline bool opensWave(const std::pair<int,int> &broadcast, int round) {
+    return broadcast.second > round;
+}
+
+#endif /* MovableRobotElection_H_ */
@@ -0,0 +1,108 @@
+#ifndef MovableRobotMessages_H_
+#define MovableRobotMessages_H_
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "comm/network.h"
+
+static const int BROADCAST_MSG_ID = 1001;
+static const int ACKNOWLEDGE_MSG_ID = 1002;
+static const int NEXT_MSG_ID = 1003;
+static const int LEADER_FOUND_MSG_ID = 1004;
+// messages of the incremental election (--incremental)
+static const int SUBTREE_MSG_ID = 1005;
+static const int SETTLED_MSG_ID = 1006;
+static const int REPAIR_MSG_ID = 1007;
+static const int RESET_MSG_ID = 1008;
+static const int DISPATCH_MSG_ID = 1009;
+// cells of the steps of concurrent movers, held by their neighbors (--movers, --regions)
+static const int LOCK_MSG_ID = 1010;
+static const int GRANT_MSG_ID = 1011;
+static const int UNLOCK_MSG_ID = 1012;
+static const int RELEASED_MSG_ID = 1013;
+// a mover settled, the module holding the election starts a new round (--movers)
+static const int WAKE_MSG_ID = 1014;
+// a module next to the destination of a step holds the other modules next to it (LOCK relayed once)
+static const int RESERVE_MSG_ID = 1015;
+
+static const int FIRST_MSG_ID = BROADCAST_MSG_ID;
+static const int NB_MSG_TYPES = RESERVE_MSG_ID - FIRST_MSG_ID + 1;
+
+/**
+ * @brief Name of a message type of this block code, as used in reports and traces
+ * @param id message type (BROADCAST_MSG_ID...)
+ */
+inline const char *messageTypeName(int id) {
+    static const char *names[NB_MSG_TYPES] = {
+        "BROADCAST", "ACKNOWLEDGE", "NEXT", "LEADER_FOUND",
+        "SUBTREE", "SETTLED", "REPAIR", "RESET", "DISPATCH",
+        "LOCK", "GRANT", "UNLOCK", "RELEASED", "WAKE", "RESERVE"
+    };
+    return (id >= FIRST_MSG_ID && id < FIRST_MSG_ID + NB_MSG_TYPES) ? names[id - FIRST_MSG_ID] : "UNKNOWN";
+}
+
+/**
+ * @brief Message of this block code: a type and a pair of ints stored inline.
+ *  Instances are recycled through a free list shared by all modules, so that a flood
+ *  does not reach the allocator once the pool has grown to the number of messages in flight.
+ */
+class PairMessage : public Message {
+    union Slot {
+        Slot *next;
+        alignas(alignof(std::max_align_t)) char bytes[1];
+    };
+    static const size_t SLOTS_PER_CHUNK = 1024;
+
+    inline static Slot *freeList = nullptr;
+    inline static std::vector<char*> chunks;
+    inline static size_t slotSize = 0;
+    inline static size_t nbAlive = 0;
+
+public:
+    std::pair<int,int> data;
+    int count;  // modules in position of the subtree of the sender (NEXT, SUBTREE and SETTLED reports),
+                // attempt of the step (LOCK, GRANT, UNLOCK, RESERVE), the election passes to the mover (LEADER_FOUND)
+    bID region; // leader of the region of the wave (--regions), 0 with a single leader
+
+    PairMessage(int t, const std::pair<int,int> &d = std::pair<int,int>(0,0), int count = 0, bID region = 0)
+        : Message(t), data(d), count(count), region(region) {}
+
+    Message* clone() const override { return new PairMessage(type,data,count,region); }
+    unsigned int size() const override { return Message::size()+sizeof(data)+sizeof(count)+sizeof(region); }
+
+    static void *operator new(size_t sz) {
+        if (freeList==nullptr) {
+            // chunk of slots of the size of the object, rounded to the alignment of the slots
+            slotSize = (sz+alignof(std::max_align_t)-1) & ~(alignof(std::max_align_t)-1);
+            char *chunk = static_cast<char*>(::operator new(slotSize*SLOTS_PER_CHUNK));
+            chunks.push_back(chunk);
+            for (size_t i=0; i<SLOTS_PER_CHUNK; i++) {
+                Slot *s = reinterpret_cast<Slot*>(chunk+i*slotSize);
+                s->next = freeList;
+                freeList = s;
+            }
+        }
+        Slot *s = freeList;
+        freeList = s->next;
+        nbAlive++;
+        return s;
+    }
+
+    static void operator delete(void *p) {
+        Slot *s = static_cast<Slot*>(p);
+        s->next = freeList;
+        freeList = s;
+        nbAlive--;
+    }
+
+    /// number of slots allocated by the pool since the beginning of the run
+    static size_t poolCapacity() { return chunks.size()*SLOTS_PER_CHUNK; }
+    /// messages not deleted yet: the simulator deletes a message once it is handled or lost on a
+    ///  disconnected interface, so the ones alive outside a handler are in flight
+    static size_t alive() { return nbAlive; }
+};
+
+#endif /* MovableRobotMessages_H_ */
@@ -0,0 +1,278 @@
+/**
+ * @file   movableRobotMicroBench.cpp
+ * @brief  Microbenchmarks of the hot paths of the movableRobot block code
+ *
+ * Each benchmark repeats one operation of the block code over a synthetic neighborhood or world
+ * and prints its host time and its heap allocations per operation, the fastest of REPEATS runs.
+ * Seeds are fixed, so that the figures of two builds can be compared.
+ *
+ *   broadcast/<d>     BROADCAST handling at a module with d neighbors (myBroadcastFunc): wave rule,
+ *                     then a copy of the message for each neighbor, held as the simulator holds it
+ *   candidate/<n>     candidate selection among n NEXT replies (acknowledgeNextFunc, subtreeBest)
+ *   motionEnd/<N>     bookkeeping of onMotionEnd in a world of N modules: occupancy index update
+ *                     and neighbor count of the settle rule (N<k>s: sparse grid, hashed index)
+ *   freeNeighbors/<N> free cells around a module of the surface and their neighbor counts (occupancy
+ *                     index queries of the settle rule and of the planner around a motion)
+ *   walkCacheHit/<N>  walkMotion answered from the motion cache of the module, which is how most
+ *                     steps of a walk are found: no simulator call, only the cache rule and the copies
+ *   isInTarget/<N>    lookup in a target of N cells, about half of the probes are out of it
+ *
+ * usage: movableRobotMicroBench [name prefix]
+ **/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "movableRobotElection.hpp"
+#include "movableRobotMessages.hpp"
+#include "movableRobotOccupancy.hpp"
+#include "movableRobotTarget.hpp"
+#include "movableRobotWalk.hpp"
+
+using namespace std;
+using namespace BaseSimulator;
+
+static const int REPEATS = 5;
+
+// every allocation of the process goes through these operators, they count them
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+    allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+// results are accumulated there so that the operations are not optimized out
+static volatile long sink = 0;
+
+static const char *prefix = "";
+
+/**
+ * @brief Runs op(0..iterations-1) REPEATS times and prints the fastest run
+ * @param name name of the benchmark, skipped if it does not start with the prefix of the command line
+ * @param iterations operations of one run
+ * @param op operation, called with its index
+ */
+static void run(const string &name, size_t iterations, const function<void(size_t)> &op) {
+    if (name.compare(0,strlen(prefix),prefix)!=0) return;
+    double bestNs = 0, allocsPerOp = 0;
+    for (int r=0; r<REPEATS; r++) {
+        size_t allocs = allocations;
+        auto start = chrono::steady_clock::now();
+        for (size_t i=0; i<iterations; i++) op(i);
+        chrono::duration<double,nano> elapsed = chrono::steady_clock::now()-start;
+        double ns = elapsed.count()/iterations;
+        if (r==0 || ns<bestNs) bestNs = ns;
+        allocsPerOp = (double)(allocations-allocs)/iterations;
+    }
+    printf("%-22s %12.1f %12.2f\n", name.c_str(), bestNs, allocsPerOp);
+}
+
+// module receiving BROADCAST (distance,round) messages, with d connected neighbors
+static void broadcastBench(int degree) {
+    mt19937 rng(1);
+    vector<pair<int,int>> broadcasts(4096);
+    int round = 0;
+    for (auto &b : broadcasts) {
+        if (rng()%8==0) round++;
+        b = make_pair(1+rng()%50,round);
+    }
+    int distance = 0, currentRound = 0;
+    vector<MessagePtr> outgoing;
+    outgoing.reserve(HHLattice::MAX_NB_NEIGHBORS);
+
+    run("broadcast/"+to_string(degree),1000000,[&](size_t i) {
+        const pair<int,int> &b = broadcasts[i%broadcasts.size()];
+        // the sequence starts again from the first round
+        if (b.second < currentRound) currentRound = 0;
+        if (opensWave(b,currentRound)) {
+            distance = b.first;
+            currentRound = b.second;
+            // sendToNeighbors: one copy for each neighbor but the sender, then the original is deleted
+            Message *msg = new PairMessage(BROADCAST_MSG_ID,make_pair(distance+1,currentRound));
+            for (int d=1; d<degree; d++) outgoing.push_back(MessagePtr(msg->clone()));
+            delete msg;
+        } else {
+            outgoing.push_back(MessagePtr(new PairMessage(NEXT_MSG_ID,make_pair(0,distance))));
+        }
+        sink += outgoing.size();
+        // the messages are freed when their receptions have been handled
+        outgoing.clear();
+    });
+}
+
+// NEXT replies of n neighbors, the best candidate is kept
+static void candidateBench(int replies) {
+    mt19937 rng(2);
+    vector<pair<int,int>> candidates(4096*replies);
+    for (auto &c : candidates) c = make_pair(1+rng()%100000,rng()%64);
+
+    run("candidate/"+to_string(replies),1000000,[&](size_t i) {
+        const pair<int,int> *c = &candidates[(i%4096)*replies];
+        pair<int,int> best(0,0);
+        for (int k=0; k<replies; k++) {
+            if (isBetterCandidate(c[k],best)) best = c[k];
+        }
+        sink += best.first;
+    });
+}
+
+// rectangle of n modules, rows of w cells, at (margin,margin) of a grid of (w+2*margin) x (rows+2*margin)
+struct SyntheticWorld {
+    HHLattice *lattice;
+    vector<Cell3DPosition> cells;
+    OccupancyIndex occupancy;
+
+    SyntheticWorld(int n, int margin) {
+        int w = max(1,(int)ceil(sqrt((double)n)));
+        int rows = (n+w-1)/w;
+        // the neighborhood depends on the parity of the rows, keep it
+        margin += margin&1;
+        lattice = new HHLattice(Cell3DPosition(w+2*margin,rows+2*margin,1),Vector3D(1,1,1));
+        for (int i=0; i<n; i++) cells.push_back(Cell3DPosition(margin+i%w,margin+i/w,0));
+        occupancy.build(lattice,cells,nullptr);
+    }
+    ~SyntheticWorld() { delete lattice; }
+
+    /// modules of the world with at least one free neighbor
+    vector<Cell3DPosition> surface() const {
+        vector<Cell3DPosition> result;
+        for (const Cell3DPosition &p : cells) {
+            if (occupancy.isOnPerimeter(p)) result.push_back(p);
+        }
+        return result;
+    }
+};
+
+static void motionEndBench(int n, bool sparse) {
+    SyntheticWorld world(n,sparse ? 10*(int)sqrt((double)n) : 2);
+    // one motion of a surface module to a free cell around it, and the motion back
+    vector<pair<Cell3DPosition,Cell3DPosition>> motions;
+    Cell3DPosition around[HHLattice::MAX_NB_NEIGHBORS];
+    for (const Cell3DPosition &p : world.surface()) {
+        if (world.occupancy.freeNeighbors(p,around)>0) motions.push_back(make_pair(p,around[0]));
+    }
+
+    string name = "motionEnd/"+to_string(n)+(sparse ? "s" : "");
+    run(name,1000000,[&](size_t i) {
+        const pair<Cell3DPosition,Cell3DPosition> &m = motions[(i/2)%motions.size()];
+        const Cell3DPosition &from = (i&1) ? m.second : m.first, &to = (i&1) ? m.first : m.second;
+        world.occupancy.move(from,to);
+        sink += world.occupancy.nbNeighbors(to);
+    });
+}
+
+static void freeNeighborsBench(int n) {
+    SyntheticWorld world(n,2);
+    vector<Cell3DPosition> surface = world.surface();
+
+    run("freeNeighbors/"+to_string(n),1000000,[&](size_t i) {
+        const Cell3DPosition &p = surface[i%surface.size()];
+        Cell3DPosition around[HHLattice::MAX_NB_NEIGHBORS];
+        int nbFree = world.occupancy.freeNeighbors(p,around);
+        for (int k=0; k<nbFree; k++) sink += world.occupancy.nbNeighbors(around[k]);
+    });
+}
+
+// cache fields of walkMotion, one per surface module as in the block codes
+struct WalkCache {
+    Hexanodes::motionDirection direction;
+    HHLattice::Direction orientation;
+    Cell3DPosition position;
+    Cell3DPosition destination;
+    uint8_t orientationCode;
+    bool valid, found;
+};
+
+static void walkCacheHitBench(int n) {
+    SyntheticWorld world(n,2);
+    vector<Cell3DPosition> surface = world.surface();
+    // every module has looked up its motion once, its first free neighbor stands for the destination
+    vector<WalkCache> caches(surface.size());
+    Cell3DPosition around[HHLattice::MAX_NB_NEIGHBORS];
+    for (size_t k=0; k<surface.size(); k++) {
+        WalkCache &c = caches[k];
+        c.direction = Hexanodes::motionDirection::CW;
+        c.orientation = HHLattice::EAST;
+        c.position = surface[k];
+        c.found = world.occupancy.freeNeighbors(surface[k],around)>0;
+        c.destination = c.found ? around[0] : Cell3DPosition();
+        c.orientationCode = k%HHLattice::MAX_NB_NEIGHBORS;
+        c.valid = true;
+    }
+    uint64_t lookups = 0, hits = 0;
+
+    run("walkCacheHit/"+to_string(n),10000000,[&](size_t i) {
+        size_t k = i%caches.size();
+        const WalkCache &c = caches[k];
+        Cell3DPosition destination;
+        HHLattice::Direction orientation = HHLattice::EAST;
+        lookups++;
+        if (walkCacheHit(c.valid,c.position,c.orientationCode,c.direction,
+                         surface[k],k%HHLattice::MAX_NB_NEIGHBORS,Hexanodes::motionDirection::CW)) {
+            hits++;
+            destination = c.destination;
+            orientation = c.orientation;
+        }
+        sink += destination[0] + orientation + c.found;
+    });
+    sink += lookups - hits;
+}
+
+static void isInTargetBench(int n) {
+    int w = max(1,(int)ceil(sqrt((double)n)));
+    int rows = (n+w-1)/w;
+    string xml = "<world><targetList><target format=\"grid\"><rect from=\"0,0,0\" to=\""
+        + to_string(w-1) + "," + to_string(rows-1) + ",0\"/></target></targetList></world>";
+    TiXmlDocument config;
+    config.Parse(xml.c_str());
+    CompactTarget target;
+    if (!target.load(&config)) {
+        fprintf(stderr,"cannot load the target of %d cells\n",n);
+        return;
+    }
+    // probes in a box twice as large as the target, around it
+    mt19937 rng(3);
+    vector<Cell3DPosition> probes(65536);
+    for (Cell3DPosition &p : probes) p.set(rng()%(2*w)-w/2,rng()%(2*rows)-rows/2,0);
+
+    run("isInTarget/"+to_string(n),10000000,[&](size_t i) {
+        sink += target.isInTarget(probes[i&(probes.size()-1)]);
+    });
+}
+
+int main(int argc, char **argv) {
+    if (argc>2 || (argc==2 && argv[1][0]=='-')) {
+        fprintf(stderr,"usage: %s [name prefix]\n",argv[0]);
+        return 1;
+    }
+    if (argc==2) prefix = argv[1];
+
+    printf("%-22s %12s %12s\n","benchmark","ns/op","allocs/op");
+    for (int d=1; d<=HHLattice::MAX_NB_NEIGHBORS; d++) broadcastBench(d);
+    for (int n : {1,3,6}) candidateBench(n);
+    for (int n : {1000,10000,100000}) motionEndBench(n,false);
+    motionEndBench(10000,true);
+    for (int n : {1000,100000}) freeNeighborsBench(n);
+    for (int n : {1000,100000}) walkCacheHitBench(n);
+    for (int n : {1000,100000,1000000}) isInTargetBench(n);
+    return 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file   movableRobotMotionLog.cpp
+ * @brief  Recorded motions of a movableRobot run and regression check
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include "movableRobotMotionLog.hpp"
+
+using namespace std;
+
+static bool readCell(const string &s, Cell3DPosition &p) {
+    int x, y, z;
+    if (sscanf(s.c_str(),"%d,%d,%d",&x,&y,&z)!=3) return false;
+    p.set(x,y,z);
+    return true;
+}
+
+static string cellString(const Cell3DPosition &p) {
+    return to_string(p[0]) + "," + to_string(p[1]) + "," + to_string(p[2]);
+}
+
+bool MotionLog::save(const string &file) const {
+    ofstream out(file);
+    if (!out) return false;
+    for (const Motion &m : motions) {
+        out << "motion " << m.module << " " << cellString(m.from) << " " << cellString(m.to)
+            << " " << m.orientation << "\n";
+    }
+    for (auto &f : finalPositions) {
+        out << "final " << f.first << " " << cellString(f.second) << "\n";
+    }
+    return (bool)out;
+}
+
+bool MotionLog::load(const string &file) {
+    ifstream in(file);
+    if (!in) return false;
+    motions.clear();
+    finalPositions.clear();
+    string line;
+    while (getline(in,line)) {
+        istringstream fields(line);
+        string kind, a, b;
+        bID id;
+        if (!(fields >> kind >> id >> a)) continue;
+        if (kind=="motion") {
+            Motion m;
+            m.module = id;
+            if (!(fields >> b >> m.orientation) || !readCell(a,m.from) || !readCell(b,m.to)) return false;
+            motions.push_back(m);
+        } else if (kind=="final") {
+            if (!readCell(a,finalPositions[id])) return false;
+        }
+    }
+    return true;
+}
+
+bool MotionLog::verify(const MotionLog &reference, const MotionLog &run, ostream &err, bool shapeOnly) {
+    bool ok = true;
+    // the shape is the set of occupied cells, whichever module holds each of them
+    set<Cell3DPosition> expected, shape;
+    for (auto &f : reference.finalPositions) expected.insert(f.second);
+    for (auto &f : run.finalPositions) shape.insert(f.second);
+    if (shape!=expected) {
+        ok = false;
+        for (const Cell3DPosition &p : expected) {
+            if (!shape.count(p)) err << "cell " << cellString(p) << " is not filled" << endl;
+        }
+        for (const Cell3DPosition &p : shape) {
+            if (!expected.count(p)) err << "cell " << cellString(p) << " is filled, not in the reference" << endl;
+        }
+    }
+    if (!shapeOnly && run.motions.size() > reference.motions.size()) {
+        ok = false;
+        err << run.motions.size() << " motions instead of " << reference.motions.size() << endl;
+    }
+    // the first divergence helps to find the change which caused it
+    if (shapeOnly) return ok;
+    size_t n = min(run.motions.size(),reference.motions.size());
+    for (size_t i=0; i<n; i++) {
+        const Motion &r = reference.motions[i], &m = run.motions[i];
+        if (r.module!=m.module || r.from!=m.from || r.to!=m.to || r.orientation!=m.orientation) {
+            err << "motions differ from motion " << i << ": module " << m.module << " " << cellString(m.from)
+                << " -> " << cellString(m.to) << ", reference module " << r.module << " "
+                << cellString(r.from) << " -> " << cellString(r.to) << endl;
+            break;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,45 @@
+#ifndef MovableRobotMotionLog_H_
+#define MovableRobotMotionLog_H_
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "grid/lattice.h"
+
+/**
+ * @brief Ordered motions of a run and final positions of the modules, recorded with
+ *  --record-motions <file> and checked with --verify-motions <file> or, for the final shape only,
+ *  --verify-shape <file> (motionRegression.sh).
+ *
+ * File format, one entry per line:
+ *      motion <blockId> <from x,y,z> <to x,y,z> <final orientation>
+ *      final <blockId> <x,y,z>
+ */
+class MotionLog {
+public:
+    struct Motion {
+        bID module;
+        Cell3DPosition from, to;
+        int orientation;
+    };
+
+    std::vector<Motion> motions;
+    std::map<bID,Cell3DPosition> finalPositions;
+
+    bool save(const std::string &file) const;
+    bool load(const std::string &file);
+
+    /**
+     * @brief Compares a run with its reference
+     * @param reference recorded run
+     * @param run current run
+     * @param err differences are written there
+     * @param shapeOnly the number of motions is not checked
+     * @return false if the final shape differs or, unless shapeOnly, if the run needs more motions
+     */
+    static bool verify(const MotionLog &reference, const MotionLog &run, std::ostream &err, bool shapeOnly = false);
+};
+
+#endif /* MovableRobotMotionLog_H_ */
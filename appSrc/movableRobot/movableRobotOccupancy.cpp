@@ -0,0 +1,165 @@
+/**
+ * @file   movableRobotOccupancy.cpp
+ * @brief  Index of the occupied cells of the movableRobot world
+ */
+
+#include "movableRobotOccupancy.hpp"
+
+#include <algorithm>
+
+using namespace std;
+using namespace BaseSimulator;
+
+void OccupancyIndex::build(HHLattice *lattice, const vector<Cell3DPosition> &cells, const CompactTarget *t) {
+    sizeX = lattice->gridSize[0];
+    sizeY = lattice->gridSize[1];
+    sizeZ = lattice->gridSize[2];
+    target = t;
+    occupiedTarget = 0;
+    nbCells = 0;
+    claimed.clear();
+
+    for (int parity=0; parity<2; parity++) {
+        Cell3DPosition ref(2,2+parity,2);
+        for (int d=0; d<HHLattice::MAX_NB_NEIGHBORS; d++) {
+            Cell3DPosition n = lattice->getCellInDirection(ref,d);
+            for (int i=0; i<3; i++) offsets[parity][d][i] = n[i]-ref[i];
+        }
+    }
+
+    size_t gridCells = (size_t)sizeX*sizeY*sizeZ;
+    size_t capacity = 16;
+    while (capacity < 2*cells.size()) capacity <<= 1;
+    dense = gridCells/64 <= capacity;
+    if (dense) {
+        bits.assign(gridCells/64+1,0);
+        slots.clear();
+    } else {
+        slots.assign(capacity,EMPTY);
+        bits.clear();
+    }
+    for (const Cell3DPosition &p : cells) insert(p);
+}
+
+void OccupancyIndex::move(const Cell3DPosition &from, const Cell3DPosition &to) {
+    erase(from);
+    insert(to);
+    for (size_t i=0; i<claimed.size(); i++) {
+        if (claimed[i]==to) {
+            claimed[i] = claimed.back();
+            claimed.pop_back();
+            break;
+        }
+    }
+}
+
+bool OccupancyIndex::isClaimed(const Cell3DPosition &p) const {
+    for (const Cell3DPosition &c : claimed) {
+        if (c==p) return true;
+    }
+    return false;
+}
+
+int OccupancyIndex::nbNeighbors(const Cell3DPosition &p) const {
+    int n = 0;
+    for (int d=0; d<HHLattice::MAX_NB_NEIGHBORS; d++) {
+        n += isOccupied(neighbor(p,d));
+    }
+    return n;
+}
+
+int OccupancyIndex::freeNeighbors(const Cell3DPosition &p, Cell3DPosition *out) const {
+    int n = 0;
+    for (int d=0; d<HHLattice::MAX_NB_NEIGHBORS; d++) {
+        Cell3DPosition q = neighbor(p,d);
+        if (inGrid(q) && !isOccupied(q)) out[n++] = q;
+    }
+    return n;
+}
+
+int OccupancyIndex::pocket(const Cell3DPosition &p, int limit, bool &targetHole) const {
+    vector<Cell3DPosition> cells(1,p);
+    targetHole = target!=nullptr;
+    for (size_t i=0; i<cells.size() && (int)cells.size()<=limit; i++) {
+        if (targetHole && target->isInTarget(cells[i])) targetHole = false;
+        for (int d=0; d<HHLattice::MAX_NB_NEIGHBORS; d++) {
+            Cell3DPosition q = neighbor(cells[i],d);
+            if (!inGrid(q)) continue;
+            if (isOccupied(q)) {
+                if (targetHole && !target->isInTarget(q)) targetHole = false;
+            } else if (std::find(cells.begin(),cells.end(),q)==cells.end()) {
+                cells.push_back(q);
+            }
+        }
+    }
+    return cells.size();
+}
+
+bool OccupancyIndex::isOnPerimeter(const Cell3DPosition &p) const {
+    if (!isOccupied(p)) return false;
+    for (int d=0; d<HHLattice::MAX_NB_NEIGHBORS; d++) {
+        Cell3DPosition q = neighbor(p,d);
+        if (inGrid(q) && !isOccupied(q)) return true;
+    }
+    return false;
+}
+
+long OccupancyIndex::find(uint64_t k) const {
+    size_t mask = slots.size()-1;
+    for (size_t i = hash(k) & mask;; i = (i+1) & mask) {
+        if (slots[i]==k) return i;
+        if (slots[i]==EMPTY) return -1;
+    }
+}
+
+void OccupancyIndex::insert(const Cell3DPosition &p) {
+    if (!inGrid(p) || isOccupied(p)) return;
+    nbCells++;
+    if (target && target->isInTarget(p)) occupiedTarget++;
+    if (dense) {
+        size_t i = index(p);
+        bits[i>>6] |= (uint64_t)1 << (i&63);
+        return;
+    }
+    if (2*nbCells > slots.size()) {
+        // keep the load factor under 1/2, probes stay short
+        vector<uint64_t> old;
+        old.swap(slots);
+        slots.assign(2*old.size(),EMPTY);
+        size_t mask = slots.size()-1;
+        for (uint64_t k : old) {
+            if (k==EMPTY) continue;
+            size_t i = hash(k) & mask;
+            while (slots[i]!=EMPTY) i = (i+1) & mask;
+            slots[i] = k;
+        }
+    }
+    size_t mask = slots.size()-1;
+    uint64_t k = key(p);
+    size_t i = hash(k) & mask;
+    while (slots[i]!=EMPTY) i = (i+1) & mask;
+    slots[i] = k;
+}
+
+void OccupancyIndex::erase(const Cell3DPosition &p) {
+    if (!inGrid(p) || !isOccupied(p)) return;
+    nbCells--;
+    if (target && target->isInTarget(p)) occupiedTarget--;
+    if (dense) {
+        size_t i = index(p);
+        bits[i>>6] &= ~((uint64_t)1 << (i&63));
+        return;
+    }
+    // backward shift: the following entries of the run move up so that no probe stops early
+    size_t mask = slots.size()-1;
+    size_t hole = find(key(p));
+    for (size_t i = (hole+1) & mask; slots[i]!=EMPTY; i = (i+1) & mask) {
+        size_t home = hash(slots[i]) & mask;
+        // the entry can fill the hole if its home slot is not between the hole and its slot
+        if (((i-home) & mask) >= ((i-hole) & mask)) {
+            slots[hole] = slots[i];
+            hole = i;
+        }
+    }
+    slots[hole] = EMPTY;
+}
@@ -0,0 +1,121 @@
+#ifndef MovableRobotOccupancy_H_
+#define MovableRobotOccupancy_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "grid/lattice.h"
+#include "movableRobotTarget.hpp"
+
+/**
+ * @brief Index of the cells occupied by the modules, shared by all the block codes and updated
+ *  at every motion end. Occupancy, neighbor and free target cell queries do not go through the
+ *  world or the lattice.
+ *
+ * Dense worlds are stored as one bit per cell of the grid. When this bitset would be larger than
+ *  a hash set of the occupied cells (about one module for more than 100 cells of the grid), the
+ *  cells are stored in an open-addressing table instead (linear probing, backward shift deletion).
+ *
+ * The neighborhood of the hexagonal lattice alternates with the parity of the row (y), the six
+ *  offsets of each parity are taken from the lattice when the index is built.
+ *
+ * The destination of a motion under way is claimed until it ends: a concurrent mover next to the same
+ *  cell may not reach the modules the first one holds (--movers, --regions).
+ */
+class OccupancyIndex {
+public:
+    /**
+     * @brief Builds the index from the positions of all the modules
+     * @param lattice lattice of the world, gives the grid size and the neighborhood
+     * @param cells occupied cells
+     * @param target target of the configuration, for the free target cell queries
+     */
+    void build(BaseSimulator::HHLattice *lattice, const std::vector<Cell3DPosition> &cells,
+               const CompactTarget *target);
+
+    /// a module moved from one cell to another, its destination is no longer claimed
+    void move(const Cell3DPosition &from, const Cell3DPosition &to);
+
+    /// a module starts a motion to p, the cell is claimed until the motion ends
+    void claim(const Cell3DPosition &p) { claimed.push_back(p); }
+
+    /// p is the destination of a motion under way
+    bool isClaimed(const Cell3DPosition &p) const;
+
+    inline bool isOccupied(const Cell3DPosition &p) const {
+        if (!inGrid(p)) return false;
+        if (dense) {
+            size_t i = index(p);
+            return (bits[i>>6] >> (i&63)) & 1;
+        }
+        return find(key(p)) >= 0;
+    }
+
+    /// number of occupied cells around p, same as getNbNeighbors() of a module in p
+    int nbNeighbors(const Cell3DPosition &p) const;
+
+    /// free cells of the grid around p, written to out (6 cells at most), returns their number
+    int freeNeighbors(const Cell3DPosition &p, Cell3DPosition *out) const;
+
+    /// occupied cell with at least one free neighbor in the grid
+    bool isOnPerimeter(const Cell3DPosition &p) const;
+
+    /**
+     * @brief Free cells connected to p (free too), counted up to limit: more means the free space
+     *  around p is open
+     * @param targetHole set when they are all out of the target and all the cells around them are in
+     *  it, a hole of the target
+     */
+    int pocket(const Cell3DPosition &p, int limit, bool &targetHole) const;
+
+    bool isFreeTarget(const Cell3DPosition &p) const {
+        return target && target->isInTarget(p) && !isOccupied(p);
+    }
+
+    /// cells of the target which are not occupied yet
+    size_t freeTargetCells() const { return target ? target->size() - occupiedTarget : 0; }
+
+    bool isDense() const { return dense; }
+
+    /// memory used by the bitset or the hash table in bytes
+    size_t memory() const { return dense ? bits.size()*sizeof(uint64_t) : slots.size()*sizeof(uint64_t); }
+
+private:
+    static constexpr uint64_t EMPTY = ~(uint64_t)0;
+
+    int sizeX=0, sizeY=0, sizeZ=0;
+    bool dense = true;
+    std::vector<uint64_t> bits;
+    std::vector<uint64_t> slots;  // packed cells, EMPTY for a free slot, size is a power of 2
+    size_t nbCells = 0;
+    const CompactTarget *target = nullptr;
+    size_t occupiedTarget = 0;
+    // destinations of the motions under way, as many as the movers
+    std::vector<Cell3DPosition> claimed;
+    // neighbor offsets (dx,dy,dz) of even and odd rows
+    int offsets[2][BaseSimulator::HHLattice::MAX_NB_NEIGHBORS][3] = {};
+
+    inline bool inGrid(const Cell3DPosition &p) const {
+        return (unsigned)p[0] < (unsigned)sizeX && (unsigned)p[1] < (unsigned)sizeY && (unsigned)p[2] < (unsigned)sizeZ;
+    }
+    inline size_t index(const Cell3DPosition &p) const {
+        return p[0] + (size_t)sizeX*(p[1] + (size_t)sizeY*p[2]);
+    }
+    static inline uint64_t key(const Cell3DPosition &p) {
+        return ((uint64_t)(uint16_t)p[0]) | ((uint64_t)(uint16_t)p[1] << 16) | ((uint64_t)(uint16_t)p[2] << 32);
+    }
+    static inline size_t hash(uint64_t k) {
+        k *= 0x9E3779B97F4A7C15ULL;
+        return k ^ (k >> 29);
+    }
+    inline Cell3DPosition neighbor(const Cell3DPosition &p, int d) const {
+        const int *o = offsets[p[1]&1][d];
+        return Cell3DPosition(p[0]+o[0],p[1]+o[1],p[2]+o[2]);
+    }
+    /// slot of k in the hash table, -1 if absent
+    long find(uint64_t k) const;
+    void insert(const Cell3DPosition &p);
+    void erase(const Cell3DPosition &p);
+};
+
+#endif /* MovableRobotOccupancy_H_ */
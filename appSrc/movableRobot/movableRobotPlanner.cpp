@@ -0,0 +1,119 @@
+/**
+ * @file   movableRobotPlanner.cpp
+ * @brief  Offline motion plan of the movableRobot reconfiguration
+ */
+
+#include <queue>
+
+#include "movableRobotPlanner.hpp"
+
+using namespace std;
+using namespace BaseSimulator;
+
+int MovableRobotPlanner::nbNeighbors(const Cell3DPosition &p) const {
+    int n = 0;
+    for (int d=0; d<HHLattice::MAX_NB_NEIGHBORS; d++) {
+        n += isOccupied(lattice->getCellInDirection(p,d));
+    }
+    return n;
+}
+
+bool MovableRobotPlanner::step(const Cell3DPosition &p, int direction, Cell3DPosition &destination) const {
+    const int n = HHLattice::MAX_NB_NEIGHBORS;
+    for (int d=0; d<n; d++) {
+        if (!isOccupied(lattice->getCellInDirection(p,d))) continue;
+        Cell3DPosition next = lattice->getCellInDirection(p,(d+direction+n)%n);
+        if (lattice->isInGrid(next) && !isOccupied(next)) {
+            destination = next;
+            return true;
+        }
+    }
+    return false;
+}
+
+int MovableRobotPlanner::walk(bID mover, Cell3DPosition &p, int direction, size_t maxSteps, vector<Motion> *path) {
+    for (size_t steps=0; steps<maxSteps; steps++) {
+        Cell3DPosition destination;
+        if (!step(p,direction,destination)) return -1;
+        occupied.erase(p);
+        occupied[destination] = mover;
+        if (path) path->push_back(Motion{mover,p,destination,direction});
+        p = destination;
+
+        // same rule as onMotionEnd
+        Cell3DPosition next;
+        bool hasNext = step(p,direction,next);
+        if (isInTarget(p) && (nbNeighbors(p)>2 || !hasNext || !isInTarget(next))) return steps+1;
+    }
+    return -1;
+}
+
+bID MovableRobotPlanner::electMover(const Cell3DPosition &leader, const map<bID,bool> &inPosition) const {
+    // breadth first wave from the leader, as the BROADCAST flood of the block code
+    map<Cell3DPosition,int> distance;
+    queue<Cell3DPosition> wave;
+    distance[leader] = 0;
+    wave.push(leader);
+    bID best = 0;
+    int bestDistance = 0;
+    while (!wave.empty()) {
+        Cell3DPosition p = wave.front();
+        wave.pop();
+        int dp = distance[p];
+        bID id = occupied.at(p);
+        if (dp>0 && !inPosition.at(id) && (dp>bestDistance || (dp==bestDistance && id>best))) {
+            best = id;
+            bestDistance = dp;
+        }
+        for (int d=0; d<HHLattice::MAX_NB_NEIGHBORS; d++) {
+            Cell3DPosition q = lattice->getCellInDirection(p,d);
+            if (isOccupied(q) && distance.emplace(q,dp+1).second) wave.push(q);
+        }
+    }
+    return best;
+}
+
+bool MovableRobotPlanner::plan(const map<bID,Cell3DPosition> &modules, bID leader) {
+    occupied.clear();
+    plannedMotions.clear();
+    nbElections = 0;
+    nbCcwWalks = 0;
+    lastError.clear();
+
+    map<bID,Cell3DPosition> position = modules;
+    map<bID,bool> inPosition;
+    for (auto &m : modules) {
+        occupied[m.second] = m.first;
+        inPosition[m.first] = isInTarget(m.second);
+    }
+    // a walk longer than the number of free cells around the whole shape cannot end
+    size_t maxSteps = 6*modules.size()+6;
+
+    for (;;) {
+        bID mover = electMover(position.at(leader),inPosition);
+        if (mover==0) return true;
+        nbElections++;
+
+        Cell3DPosition p = position[mover];
+        int direction = CW;
+        if (shortest) {
+            // both walks are tried on a copy of the occupied cells
+            map<Cell3DPosition,bID> initial = occupied;
+            Cell3DPosition q = p;
+            int cw = walk(mover,q,CW,maxSteps,nullptr);
+            occupied = initial;
+            q = p;
+            int ccw = walk(mover,q,CCW,maxSteps,nullptr);
+            occupied = initial;
+            if (ccw>=0 && (cw<0 || ccw<cw)) direction = CCW;
+            nbCcwWalks += direction==CCW;
+        }
+        if (walk(mover,p,direction,maxSteps,&plannedMotions)<0) {
+            lastError = "module " + to_string(mover) + " cannot reach the target from " + p.to_string();
+            return false;
+        }
+        position[mover] = p;
+        inPosition[mover] = true;
+        leader = mover;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef MovableRobotPlanner_H_
+#define MovableRobotPlanner_H_
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "grid/lattice.h"
+
+/**
+ * @brief Centralized version of the election and clockwise walk of MovableRobotBlockCode.
+ *  From the initial positions of the modules, it computes the whole ordered sequence of
+ *  motions: the farthest module (then the highest id) from the leader that is not in position
+ *  walks clockwise along the surface until it settles in the target, then becomes the leader.
+ *
+ * The clockwise step of a module around a neighbor in direction d is modeled as a rotation to
+ *  the cell in direction d+1, when it is free (d-1 for a counterclockwise step). The replay
+ *  (--planner) checks every step against the motions given by the simulator.
+ *
+ * With shortest set, each mover walks in the direction (CW or CCW) which settles it in fewer steps.
+ */
+class MovableRobotPlanner {
+public:
+    // walking directions, same values as Hexanodes::motionDirection
+    enum { CW=1, CCW=-1 };
+
+    struct Motion {
+        bID module;
+        Cell3DPosition from, to;
+        int direction;
+    };
+
+    typedef std::function<bool(const Cell3DPosition&)> TargetFunc;
+
+    /**
+     * @param lattice lattice of the world, used for the neighborhood of the cells
+     * @param isInTarget membership of the target
+     */
+    MovableRobotPlanner(BaseSimulator::HHLattice *lattice, const TargetFunc &isInTarget)
+        : lattice(lattice), isInTarget(isInTarget) {}
+
+    /**
+     * @brief Computes the plan of the whole reconfiguration
+     * @param modules initial position of each module
+     * @param leader id of the first leader
+     * @return false if a mover cannot reach the target (no clockwise motion or endless walk),
+     *  the plan then ends with the motions of this mover
+     */
+    bool plan(const std::map<bID,Cell3DPosition> &modules, bID leader);
+
+    /// walk direction of each mover chosen by the shortest walk instead of always CW
+    bool shortest = false;
+
+    const std::vector<Motion> &motions() const { return plannedMotions; }
+    size_t elections() const { return nbElections; }
+    size_t ccwWalks() const { return nbCcwWalks; }
+    const std::string &error() const { return lastError; }
+
+private:
+    BaseSimulator::HHLattice *lattice;
+    TargetFunc isInTarget;
+    std::map<Cell3DPosition,bID> occupied;
+    std::vector<Motion> plannedMotions;
+    size_t nbElections = 0;
+    size_t nbCcwWalks = 0;
+    std::string lastError;
+
+    bool isOccupied(const Cell3DPosition &p) const { return occupied.count(p)!=0; }
+    int nbNeighbors(const Cell3DPosition &p) const;
+    /// destination of the first motion in direction (CW or CCW) from p, false if there is none
+    bool step(const Cell3DPosition &p, int direction, Cell3DPosition &destination) const;
+    /// walks the mover from p until it settles, its motions are appended to path if not null
+    int walk(bID mover, Cell3DPosition &p, int direction, size_t maxSteps, std::vector<Motion> *path);
+    /// farthest module from the leader which is not in position, 0 if none
+    bID electMover(const Cell3DPosition &leader, const std::map<bID,bool> &inPosition) const;
+};
+
+#endif /* MovableRobotPlanner_H_ */
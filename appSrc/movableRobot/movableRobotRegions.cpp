@@ -0,0 +1,143 @@
+/**
+ * @file   movableRobotRegions.cpp
+ * @brief  Partition of the modules and of the target between several leaders
+ */
+
+#include <algorithm>
+#include <queue>
+#include <utility>
+
+#include "movableRobotRegions.hpp"
+
+using namespace std;
+using namespace BaseSimulator;
+
+void RegionMap::build(HHLattice *lattice, const map<bID,Cell3DPosition> &modules,
+                      vector<bID> leaders, size_t nbRegions, const CompactTarget *target) {
+    regionLeaders.clear();
+    moduleRegion.clear();
+    cellRegion.clear();
+    sliceSizes.clear();
+    if (modules.empty()) return;
+
+    map<Cell3DPosition,bID> occupied;
+    for (auto &m : modules) occupied[m.second] = m.first;
+    for (bID l : leaders) {
+        if (modules.count(l) && find(regionLeaders.begin(),regionLeaders.end(),l)==regionLeaders.end()) {
+            regionLeaders.push_back(l);
+        }
+    }
+    if (regionLeaders.empty()) regionLeaders.push_back(modules.begin()->first);
+
+    // farthest point sampling through the modules
+    while (regionLeaders.size() < nbRegions) {
+        map<Cell3DPosition,int> distance;
+        queue<Cell3DPosition> wave;
+        for (bID l : regionLeaders) {
+            distance[modules.at(l)] = 0;
+            wave.push(modules.at(l));
+        }
+        bID farthest = 0;
+        int farthestDistance = 0;
+        while (!wave.empty()) {
+            Cell3DPosition p = wave.front();
+            wave.pop();
+            int dp = distance[p];
+            bID id = occupied[p];
+            if (dp > farthestDistance || (dp == farthestDistance && dp > 0 && id > farthest)) {
+                farthest = id;
+                farthestDistance = dp;
+            }
+            for (int d=0; d<HHLattice::MAX_NB_NEIGHBORS; d++) {
+                Cell3DPosition q = lattice->getCellInDirection(p,d);
+                if (occupied.count(q) && distance.emplace(q,dp+1).second) wave.push(q);
+            }
+        }
+        if (farthest==0) break;
+        regionLeaders.push_back(farthest);
+    }
+
+    // each module joins the leader whose wave through the modules reaches it first: a region is
+    // connected by its own modules, its rounds reach all of them at the start
+    queue<Cell3DPosition> wave;
+    for (bID l : regionLeaders) {
+        moduleRegion[l] = l;
+        wave.push(modules.at(l));
+    }
+    while (!wave.empty()) {
+        Cell3DPosition p = wave.front();
+        wave.pop();
+        bID r = moduleRegion[occupied[p]];
+        for (int d=0; d<HHLattice::MAX_NB_NEIGHBORS; d++) {
+            auto it = occupied.find(lattice->getCellInDirection(p,d));
+            if (it!=occupied.end() && moduleRegion.emplace(it->second,r).second) wave.push(it->first);
+        }
+    }
+
+    // hops from each leader to the cells of the target, through the modules and the target
+    map<Cell3DPosition,bool> inTarget;
+    if (target) {
+        for (const Cell3DPosition &p : target->cells()) inTarget[p] = true;
+    }
+    vector<map<Cell3DPosition,int>> distances(regionLeaders.size());
+    for (size_t r=0; r<regionLeaders.size(); r++) {
+        map<Cell3DPosition,int> &distance = distances[r];
+        queue<Cell3DPosition> wave;
+        distance[modules.at(regionLeaders[r])] = 0;
+        wave.push(modules.at(regionLeaders[r]));
+        while (!wave.empty()) {
+            Cell3DPosition p = wave.front();
+            wave.pop();
+            for (int d=0; d<HHLattice::MAX_NB_NEIGHBORS; d++) {
+                Cell3DPosition q = lattice->getCellInDirection(p,d);
+                if ((occupied.count(q) || inTarget.count(q)) && distance.emplace(q,distance[p]+1).second) wave.push(q);
+            }
+        }
+    }
+    // index of the closest region, the first one for the cells out of reach
+    auto closest = [&](const Cell3DPosition &p) {
+        size_t best = 0;
+        int bestDistance = -1;
+        for (size_t r=0; r<distances.size(); r++) {
+            auto it = distances[r].find(p);
+            if (it!=distances[r].end() && (bestDistance<0 || it->second<bestDistance)) {
+                best = r;
+                bestDistance = it->second;
+            }
+        }
+        return best;
+    };
+
+    // modules out of reach of every leader join the first region
+    vector<size_t> capacity(regionLeaders.size(),0);
+    for (auto &m : modules) {
+        bID r = moduleRegion.emplace(m.first,regionLeaders[0]).first->second;
+        capacity[find(regionLeaders.begin(),regionLeaders.end(),r)-regionLeaders.begin()]++;
+    }
+
+    // a region gets as many target cells as it has modules, the closest ones first,
+    // cells already holding a module stay with it
+    for (auto &m : modules) {
+        if (!inTarget.count(m.second)) continue;
+        bID r = moduleRegion[m.first];
+        cellRegion[m.second] = r;
+        capacity[find(regionLeaders.begin(),regionLeaders.end(),r)-regionLeaders.begin()]--;
+    }
+    vector<pair<int,pair<Cell3DPosition,size_t>>> offers;
+    for (size_t r=0; r<distances.size(); r++) {
+        for (auto &c : inTarget) {
+            auto it = distances[r].find(c.first);
+            if (it!=distances[r].end() && !cellRegion.count(c.first)) offers.push_back({it->second,{c.first,r}});
+        }
+    }
+    sort(offers.begin(),offers.end());
+    for (auto &o : offers) {
+        size_t r = o.second.second;
+        if (capacity[r]>0 && cellRegion.emplace(o.second.first,regionLeaders[r]).second) capacity[r]--;
+    }
+    // more target cells than modules: the rest goes to the closest region
+    for (auto &c : inTarget) {
+        if (!cellRegion.count(c.first)) cellRegion[c.first] = regionLeaders[closest(c.first)];
+    }
+    for (auto &c : cellRegion) sliceSizes[c.second]++;
+}
@@ -0,0 +1,60 @@
+#ifndef MovableRobotRegions_H_
+#define MovableRobotRegions_H_
+
+#include <map>
+#include <vector>
+
+#include "grid/lattice.h"
+#include "movableRobotTarget.hpp"
+
+/**
+ * @brief Partition of the modules and of the target into regions, one per leader (--regions <n>
+ *  or several leader="true" blocks). It is computed once from the initial configuration and
+ *  shared by all the block codes, like the target.
+ *
+ * Leaders of the configuration are completed up to the requested number of regions by farthest
+ *  point sampling: the next leader is the module farthest (in hops) from the leaders already
+ *  chosen. Each module belongs to the leader it is the closest to, counting hops through the
+ *  modules only, so that every region is connected. A region gets a slice of the target of as
+ *  many cells as it has modules, the target cells closest to its leader first (in hops through
+ *  the modules and the target cells): the region is done once that many of its modules are in
+ *  position. Its movers settle in the first free cell of the target they reach, whatever its slice:
+ *  a mover walking past the cells of another region would leave pockets that no walk enters. The
+ *  modules of the other regions relay the rounds of a region, which reach its movers once they
+ *  have settled next to another region.
+ */
+class RegionMap {
+public:
+    /**
+     * @param lattice lattice of the world, for the neighborhood of the cells
+     * @param modules initial position of each module
+     * @param leaders leaders of the configuration, the first region is the one of leaders[0]
+     * @param nbRegions number of regions, at least leaders.size()
+     * @param target target of the configuration, null if it is not a grid target
+     */
+    void build(BaseSimulator::HHLattice *lattice, const std::map<bID,Cell3DPosition> &modules,
+               std::vector<bID> leaders, size_t nbRegions, const CompactTarget *target);
+
+    /// region (id of its leader) of a module, 0 if the module is unknown
+    bID regionOf(bID module) const {
+        auto it = moduleRegion.find(module);
+        return it==moduleRegion.end() ? 0 : it->second;
+    }
+
+    /// number of target cells of a region
+    size_t sliceSize(bID region) const {
+        auto it = sliceSizes.find(region);
+        return it==sliceSizes.end() ? 0 : it->second;
+    }
+
+    const std::vector<bID> &leaders() const { return regionLeaders; }
+    size_t count() const { return regionLeaders.size(); }
+
+private:
+    std::vector<bID> regionLeaders;
+    std::map<bID,bID> moduleRegion;
+    std::map<Cell3DPosition,bID> cellRegion;
+    std::map<bID,size_t> sliceSizes;
+};
+
+#endif /* MovableRobotRegions_H_ */
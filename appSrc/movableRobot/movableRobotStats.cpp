@@ -0,0 +1,136 @@
+/**
+ * @file   movableRobotStats.cpp
+ * @brief  Run counters and JSON report of the movableRobot block code
+ */
+
+#ifdef __linux__
+#include <malloc.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+
+#include "movableRobotStats.hpp"
+
+using namespace std;
+
+uint64_t MovableRobotStats::totalMessages() {
+    uint64_t total = 0;
+    for (uint64_t n : messages) total += n;
+    return total;
+}
+
+size_t MovableRobotStats::heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#elif defined(__GLIBC__)
+    return (unsigned)mallinfo().uordblks;
+#else
+    return 0;
+#endif
+}
+
+// string value of the report: quotes, backslashes and control characters escaped
+static string jsonString(const string &s) {
+    string out = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+void MovableRobotStats::writeReport(ostream &out, const string &config, size_t nbModules,
+                                    uint64_t motions, uint64_t simulatedTime, double wallClockMs) {
+    out << "{\"config\":" << jsonString(config)
+        << ",\"modules\":" << nbModules
+        << ",\"completed\":" << (completed ? "true" : "false")
+        << ",\"makespan\":" << makespan
+        << ",\"simulatedTime\":" << simulatedTime
+        << ",\"motions\":" << motions
+        << ",\"rounds\":" << rounds
+        << ",\"elections\":" << elections
+        << ",\"motionCache\":{\"lookups\":" << motionLookups << ",\"hits\":" << motionCacheHits
+        << ",\"hitRate\":" << (motionLookups ? (double)motionCacheHits/motionLookups : 0.0) << "}"
+        << ",\"ccwWalks\":" << ccwWalks
+        << ",\"plannedMotions\":" << plannedMotions
+        << ",\"planDivergences\":" << planDivergences
+        << ",\"regions\":" << regions
+        << ",\"messages\":{";
+    for (int i = 0; i < NB_MSG_TYPES; i++) {
+        out << (i ? "," : "") << "\"" << messageTypeName(FIRST_MSG_ID + i) << "\":" << messages[i];
+    }
+    out << "},\"totalMessages\":" << totalMessages()
+        << ",\"messagesPerMotion\":" << (motions ? (double)totalMessages()/motions : 0.0)
+        << ",\"messagesPerSecond\":" << (wallClockMs>0 ? totalMessages()*1000.0/wallClockMs : 0.0)
+        << ",\"messagePoolSlots\":" << PairMessage::poolCapacity()
+        // total heap taken by loading the world over the number of modules: the configuration
+        // document, the lattice, the modules with their interfaces and their block codes, and what
+        // the startup of a module adds (the handlers of its mode, measured on the first one)
+        << ",\"memory\":{\"heapPerModule\":"
+        << (nbModules && heapAtStartup>heapAtStart ? (heapAtStartup-heapAtStart)/nbModules+moduleStartupBytes : 0)
+        << ",\"blockCodeBytes\":" << blockCodeBytes << "}"
+        << ",\"startupMs\":" << startupMs
+        << ",\"wallClockMs\":" << wallClockMs
+        << "}" << endl;
+}
+
+void MovableRobotStats::writeMetrics(ostream &out, uint64_t motions, uint64_t simulatedTime, uint32_t leader,
+                                     int round, size_t inPosition, size_t targetSize) {
+    out << "# HELP movablerobot_motions_total Motions of the modules\n"
+        << "# TYPE movablerobot_motions_total counter\n"
+        << "movablerobot_motions_total " << motions << "\n"
+        << "# HELP movablerobot_simulated_seconds Simulated date\n"
+        << "# TYPE movablerobot_simulated_seconds gauge\n"
+        << "movablerobot_simulated_seconds " << simulatedTime/1e6 << "\n"
+        << "# HELP movablerobot_motions_per_simulated_second Motions over the simulated time\n"
+        << "# TYPE movablerobot_motions_per_simulated_second gauge\n"
+        << "movablerobot_motions_per_simulated_second " << (simulatedTime ? motions*1e6/simulatedTime : 0.0) << "\n"
+        << "# HELP movablerobot_messages_total Messages sent by type\n"
+        << "# TYPE movablerobot_messages_total counter\n";
+    for (int i = 0; i < NB_MSG_TYPES; i++) {
+        out << "movablerobot_messages_total{type=\"" << messageTypeName(FIRST_MSG_ID + i) << "\"} " << messages[i] << "\n";
+    }
+    // a message sent and neither handled nor lost yet is alive, and an event of the scheduler queue;
+    // the metrics are written between two handlers, no message is being handled
+    uint64_t inFlight = PairMessage::alive();
+    uint64_t dropped = totalMessages() - received - min<uint64_t>(inFlight,totalMessages() - received);
+    out << "# HELP movablerobot_messages_in_flight Messages sent and neither received nor lost yet\n"
+        << "# TYPE movablerobot_messages_in_flight gauge\n"
+        << "movablerobot_messages_in_flight " << inFlight << "\n"
+        << "# HELP movablerobot_messages_dropped_total Messages lost on an interface disconnected before their delivery\n"
+        << "# TYPE movablerobot_messages_dropped_total counter\n"
+        << "movablerobot_messages_dropped_total " << dropped << "\n"
+        << "# HELP movablerobot_queued_events Events of the block code in the scheduler queue: messages in flight and motions under way\n"
+        << "# TYPE movablerobot_queued_events gauge\n"
+        << "movablerobot_queued_events " << inFlight + motionsUnderWay << "\n"
+        << "# HELP movablerobot_rounds_total Flooded election rounds\n"
+        << "# TYPE movablerobot_rounds_total counter\n"
+        << "movablerobot_rounds_total " << rounds << "\n"
+        << "# HELP movablerobot_round Current round of the module holding the election\n"
+        << "# TYPE movablerobot_round gauge\n"
+        << "movablerobot_round " << round << "\n"
+        << "# HELP movablerobot_elections_total Modules selected to move\n"
+        << "# TYPE movablerobot_elections_total counter\n"
+        << "movablerobot_elections_total " << elections << "\n"
+        << "# HELP movablerobot_leader_id Module which flooded the last round or is moving\n"
+        << "# TYPE movablerobot_leader_id gauge\n"
+        << "movablerobot_leader_id " << leader << "\n"
+        << "# HELP movablerobot_modules_in_position Modules settled in the target\n"
+        << "# TYPE movablerobot_modules_in_position gauge\n"
+        << "movablerobot_modules_in_position " << inPosition << "\n"
+        << "# HELP movablerobot_target_cells Cells of the target\n"
+        << "# TYPE movablerobot_target_cells gauge\n"
+        << "movablerobot_target_cells " << targetSize << "\n"
+        << "# HELP movablerobot_completed The target is filled\n"
+        << "# TYPE movablerobot_completed gauge\n"
+        << "movablerobot_completed " << (completed ? 1 : 0) << "\n";
+}
@@ -0,0 +1,73 @@
+#ifndef MovableRobotStats_H_
+#define MovableRobotStats_H_
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "movableRobotMessages.hpp"
+
+/**
+ * @brief Counters of a whole run of the movableRobot block code, shared by all modules.
+ *  They are written as a JSON report at the end of the simulation (--report <file>).
+ */
+class MovableRobotStats {
+public:
+    inline static uint64_t messages[NB_MSG_TYPES] = {};
+    inline static uint64_t rounds = 0;     // flooded election rounds
+    inline static uint64_t elections = 0;  // modules selected to move
+    inline static uint64_t makespan = 0;   // simulated date of the last motion end
+    inline static bool completed = false;  // the target was filled (termination detection)
+    inline static uint64_t received = 0;   // messages handled, the others are in flight or were lost
+    inline static uint64_t motionsUnderWay = 0;  // motions scheduled and not ended, one event of the queue each
+    inline static uint64_t timeOffset = 0; // simulated date of the snapshot a run was resumed from
+    inline static uint64_t motionLookups = 0;    // walk motion queries, in the walk direction of the module
+    inline static uint64_t motionCacheHits = 0;  // queries answered without getAllMotionsForModule
+    inline static uint64_t ccwWalks = 0;         // movers which walked counterclockwise (--planner --shortest)
+    inline static uint64_t plannedMotions = 0;   // motions of the offline plan (--planner, --plan-only)
+    inline static uint64_t planDivergences = 0;  // replayed steps which are not the motion of the simulator in their direction
+    inline static uint64_t regions = 1;          // leaders running their own rounds (--regions)
+    inline static size_t heapAtStart = 0;        // heap in use before the world is loaded
+    inline static size_t heapAtStartup = 0;      // heap in use once all the modules are created
+    inline static size_t blockCodeBytes = 0;     // size of the state of one block code, its LockState included
+    inline static size_t moduleStartupBytes = 0; // heap taken by the startup of a module: handlers, LockState
+    inline static std::chrono::steady_clock::time_point startTime; // start of main
+    inline static double startupMs = 0;          // host time to load the world, up to the first startup
+
+    static void countMessage(int type, int n = 1) {
+        if (type >= FIRST_MSG_ID && type < FIRST_MSG_ID + NB_MSG_TYPES) messages[type - FIRST_MSG_ID] += n;
+    }
+
+    static uint64_t totalMessages();
+
+    /// bytes of heap in use, 0 when the C library cannot tell
+    static size_t heapInUse();
+
+    /**
+     * @brief Writes the report of the run as a single line JSON object
+     * @param out output stream
+     * @param config configuration file of the run
+     * @param nbModules number of modules of the world
+     * @param motions number of motions of the run
+     * @param simulatedTime simulated date at the end of the run
+     * @param wallClockMs host time of the run in milliseconds, loading of the world (startupMs) included
+     */
+    static void writeReport(std::ostream &out, const std::string &config, size_t nbModules,
+                            uint64_t motions, uint64_t simulatedTime, double wallClockMs);
+
+    /**
+     * @brief Writes the current counters in the Prometheus text exposition format
+     * @param out output stream
+     * @param motions number of motions so far
+     * @param simulatedTime current simulated date
+     * @param leader module which flooded the last round or is moving
+     * @param round current round of that module
+     * @param inPosition number of modules in position
+     * @param targetSize number of cells of the target, 0 if unknown
+     */
+    static void writeMetrics(std::ostream &out, uint64_t motions, uint64_t simulatedTime, uint32_t leader,
+                             int round, size_t inPosition, size_t targetSize);
+};
+
+#endif /* MovableRobotStats_H_ */
@@ -0,0 +1,288 @@
+/**
+ * @file   movableRobotSweep.cpp
+ * @brief  Parallel parameter sweep of the movableRobot block code
+ *
+ * Runs the simulator once per point of a parameter grid, as independent headless processes
+ * spread over all the cores, then merges the JSON report of every run into one table.
+ *
+ * The grid file has one simulator or block code option per line followed by its values,
+ * the runs are the cartesian product of the lines (# starts a comment):
+ *      -c               config.xml cylinder2block.xml
+ *      --leader-id      1 5 9
+ *      --message-delay  500 1000 2000
+ *      --motion-delay   50000 100000
+ *      --timing-seed    1 2 3
+ *      --incremental
+ * An option without values is passed to every run. A run the simulator rejects because its
+ * parameters do not apply to the world (exit status 2, e.g. a --leader-id which is not one of its
+ * modules) is reported as skipped, not as failed.
+ *
+ * usage: movableRobotSweep <movableRobot binary> <worlds directory> <grid file> [table.tsv] [-j N]
+ *   VSIM_FLAGS overrides the simulator flags (default: terminal mode, fastest, exit at the end)
+ **/
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern char **environ;
+
+using namespace std;
+
+struct Parameter {
+    string option;
+    vector<string> values;
+};
+
+struct Run {
+    size_t index;
+    vector<string> values;  // one per parameter with values
+    bool ok = false;
+    bool skipped = false;   // parameters that do not apply to the world of the run
+    string report;          // JSON line written by the run
+};
+
+// columns of the table, taken from the top level fields of the report
+static const char *FIELDS[] = {
+    "modules", "makespan", "simulatedTime", "motions", "rounds", "elections", "totalMessages", "wallClockMs"
+};
+
+// deque of run indices of a worker, the owner pops at the back, thieves take the front
+struct WorkQueue {
+    mutex lock;
+    deque<size_t> runs;
+
+    bool pop(size_t &r) {
+        lock_guard<mutex> guard(lock);
+        if (runs.empty()) return false;
+        r = runs.back();
+        runs.pop_back();
+        return true;
+    }
+
+    bool steal(size_t &r) {
+        lock_guard<mutex> guard(lock);
+        if (runs.empty()) return false;
+        r = runs.front();
+        runs.pop_front();
+        return true;
+    }
+};
+
+static bool readGrid(const string &file, vector<Parameter> &grid) {
+    ifstream in(file);
+    if (!in) return false;
+    string line;
+    while (getline(in,line)) {
+        line = line.substr(0,line.find('#'));
+        istringstream words(line);
+        Parameter p;
+        if (!(words >> p.option)) continue;
+        string v;
+        while (words >> v) p.values.push_back(v);
+        grid.push_back(p);
+    }
+    return true;
+}
+
+// value of a top level numeric or string field of a one line JSON object, empty if missing
+static string jsonField(const string &json, const string &name) {
+    int depth = 0;
+    string key = "\"" + name + "\":";
+    for (size_t i=0; i<json.size(); i++) {
+        char c = json[i];
+        if (c=='"') {
+            if (depth==1 && json.compare(i,key.size(),key)==0) {
+                size_t b = i+key.size(), e = b;
+                if (json[b]=='"') {
+                    e = json.find('"',b+1);
+                    return json.substr(b+1,e-b-1);
+                }
+                while (e<json.size() && json[e]!=',' && json[e]!='}') e++;
+                return json.substr(b,e-b);
+            }
+            i = json.find('"',i+1);
+            if (i==string::npos) break;
+        } else if (c=='{') depth++;
+        else if (c=='}') depth--;
+    }
+    return "";
+}
+
+// exit status of the process, -1 when it cannot be started or does not exit
+static int execute(const vector<string> &args) {
+    vector<char*> argv;
+    for (const string &a : args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions,STDOUT_FILENO,"/dev/null",O_WRONLY,0);
+    posix_spawn_file_actions_addopen(&actions,STDERR_FILENO,"/dev/null",O_WRONLY,0);
+    pid_t pid;
+    int err = posix_spawn(&pid,argv[0],&actions,nullptr,argv.data(),environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err!=0) return -1;
+
+    int status;
+    while (waitpid(pid,&status,0)<0) {
+        if (errno!=EINTR) return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char **argv) {
+    vector<string> positional;
+    unsigned workers = max(1u,thread::hardware_concurrency());
+    for (int i=1; i<argc; i++) {
+        if (string(argv[i])=="-j" && i+1<argc) workers = max(1,atoi(argv[++i]));
+        else positional.push_back(argv[i]);
+    }
+    if (positional.size()<3) {
+        cerr << "usage: " << argv[0] << " <movableRobot binary> <worlds directory> <grid file> [table.tsv] [-j N]" << endl;
+        return 1;
+    }
+
+    char *path = realpath(positional[0].c_str(),nullptr);
+    if (path==nullptr || access(path,X_OK)!=0) {
+        cerr << positional[0] << " not found, run make first" << endl;
+        return 1;
+    }
+    string exec = path;
+    free(path);
+
+    vector<Parameter> grid;
+    if (!readGrid(positional[2],grid)) {
+        cerr << "cannot read grid " << positional[2] << endl;
+        return 1;
+    }
+    ofstream tableFile;
+    if (positional.size()>3) {
+        tableFile.open(positional[3]);
+        if (!tableFile) {
+            cerr << "cannot write " << positional[3] << endl;
+            return 1;
+        }
+    }
+    ostream &table = positional.size()>3 ? tableFile : cout;
+
+    // the worlds are given relative to their directory, like in benchmark.sh
+    if (chdir(positional[1].c_str())!=0) {
+        cerr << "cannot open " << positional[1] << endl;
+        return 1;
+    }
+    char tmpl[] = "/tmp/movableRobotSweep.XXXXXX";
+    if (mkdtemp(tmpl)==nullptr) {
+        cerr << "cannot create a temporary directory" << endl;
+        return 1;
+    }
+    string tmpDir = tmpl;
+
+    vector<string> flags;
+    const char *vsimFlags = getenv("VSIM_FLAGS");
+    istringstream fw(vsimFlags ? vsimFlags : "-t -R -x");
+    for (string f; fw >> f;) flags.push_back(f);
+
+    // cartesian product of the parameters with values, the last one varies first
+    vector<const Parameter*> axes;
+    size_t nbRuns = 1;
+    for (const Parameter &p : grid) {
+        if (p.values.empty()) continue;
+        axes.push_back(&p);
+        nbRuns *= p.values.size();
+    }
+    vector<Run> runs(nbRuns);
+    for (size_t r=0; r<nbRuns; r++) {
+        runs[r].index = r;
+        size_t k = r;
+        runs[r].values.resize(axes.size());
+        for (size_t a=axes.size(); a-->0;) {
+            runs[r].values[a] = axes[a]->values[k%axes[a]->values.size()];
+            k /= axes[a]->values.size();
+        }
+    }
+
+    workers = min<size_t>(workers,max<size_t>(1,nbRuns));
+    vector<WorkQueue> queues(workers);
+    for (size_t r=0; r<nbRuns; r++) queues[r%workers].runs.push_back(r);
+
+    atomic<size_t> done(0);
+    mutex outputLock;
+    auto start = chrono::steady_clock::now();
+
+    auto work = [&](unsigned w) {
+        size_t r;
+        for (;;) {
+            bool found = queues[w].pop(r);
+            for (unsigned k=1; !found && k<workers; k++) found = queues[(w+k)%workers].steal(r);
+            if (!found) return;
+
+            Run &run = runs[r];
+            string report = tmpDir + "/run" + to_string(r) + ".jsonl";
+            vector<string> args = {exec};
+            size_t a = 0;
+            for (const Parameter &p : grid) {
+                args.push_back(p.option);
+                if (!p.values.empty()) args.push_back(run.values[a++]);
+            }
+            args.insert(args.end(),flags.begin(),flags.end());
+            args.push_back("--report");
+            args.push_back(report);
+
+            int status = execute(args);
+            run.ok = status==0;
+            run.skipped = status==2;
+            ifstream in(report);
+            if (!getline(in,run.report)) run.ok = false;
+            unlink(report.c_str());
+
+            size_t n = ++done;
+            lock_guard<mutex> guard(outputLock);
+            cerr << "\r" << n << "/" << nbRuns << " runs" << flush;
+        }
+    };
+
+    vector<thread> pool;
+    for (unsigned w=0; w<workers; w++) pool.emplace_back(work,w);
+    for (thread &t : pool) t.join();
+    rmdir(tmpDir.c_str());
+
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+    cerr << "\r" << nbRuns << " runs in " << elapsed << " s on " << workers << " workers" << endl;
+
+    // one row per run in grid order, failed runs keep their parameters and an empty report
+    table << "run";
+    for (const Parameter *p : axes) {
+        table << "\t" << (p->option=="-c" ? "config" : p->option.substr(p->option.find_first_not_of('-')));
+    }
+    for (const char *f : FIELDS) table << "\t" << f;
+    table << "\tstatus\n";
+    int failed = 0, skipped = 0;
+    for (const Run &run : runs) {
+        table << run.index;
+        for (const string &v : run.values) table << "\t" << v;
+        for (const char *f : FIELDS) table << "\t" << (run.skipped ? "" : jsonField(run.report,f));
+        table << "\t" << (run.ok ? "ok" : run.skipped ? "skipped" : "FAILED") << "\n";
+        failed += !run.ok && !run.skipped;
+        skipped += run.skipped;
+    }
+    if (skipped) cerr << skipped << " runs skipped, their parameters do not apply to their world" << endl;
+
+    return failed ? 1 : 0;
+}
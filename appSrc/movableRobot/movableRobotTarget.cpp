@@ -0,0 +1,94 @@
+/**
+ * @file   movableRobotTarget.cpp
+ * @brief  Bitset grid target shared by the movableRobot block codes
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "movableRobotTarget.hpp"
+
+using namespace std;
+
+namespace {
+struct Box {
+    int from[3], to[3];
+};
+
+bool readPosition(const char *attr, int *p) {
+    return attr && sscanf(attr, "%d,%d,%d", &p[0], &p[1], &p[2]) == 3;
+}
+}
+
+bool CompactTarget::load(TiXmlDocument *config) {
+    TiXmlNode *node = config->FirstChild("world");
+    if (node) node = node->FirstChild("targetList");
+    if (node) node = node->FirstChild("target");
+    if (!node) return false;
+
+    TiXmlElement *targetElement = node->ToElement();
+    const char *format = targetElement ? targetElement->Attribute("format") : nullptr;
+    if (format && strcmp(format, "grid") != 0) return false;
+
+    // first pass: boxes and bounding box
+    vector<Box> boxes;
+    for (TiXmlElement *e = node->FirstChildElement(); e; e = e->NextSiblingElement()) {
+        Box b;
+        if (strcmp(e->Value(), "cell") == 0 && readPosition(e->Attribute("position"), b.from)) {
+            copy(b.from, b.from + 3, b.to);
+        } else if (strcmp(e->Value(), "rect") == 0 && readPosition(e->Attribute("from"), b.from)
+                   && readPosition(e->Attribute("to"), b.to)) {
+            for (int k = 0; k < 3; k++) {
+                if (b.from[k] > b.to[k]) swap(b.from[k], b.to[k]);
+            }
+        } else continue;
+        boxes.push_back(b);
+    }
+    if (boxes.empty()) return false;
+
+    int maxP[3] = {boxes[0].to[0], boxes[0].to[1], boxes[0].to[2]};
+    minX = boxes[0].from[0];
+    minY = boxes[0].from[1];
+    minZ = boxes[0].from[2];
+    for (const Box &b : boxes) {
+        minX = min(minX, b.from[0]);
+        minY = min(minY, b.from[1]);
+        minZ = min(minZ, b.from[2]);
+        for (int k = 0; k < 3; k++) maxP[k] = max(maxP[k], b.to[k]);
+    }
+    sizeX = maxP[0] - minX + 1;
+    sizeY = maxP[1] - minY + 1;
+    sizeZ = maxP[2] - minZ + 1;
+    bits.assign(((size_t)sizeX * sizeY * sizeZ + 63) / 64, 0);
+
+    // second pass: set the bits, cells listed twice are counted once
+    nbCells = 0;
+    for (const Box &b : boxes) {
+        for (int z = b.from[2]; z <= b.to[2]; z++) {
+            for (int y = b.from[1]; y <= b.to[1]; y++) {
+                for (int x = b.from[0]; x <= b.to[0]; x++) {
+                    size_t i = (x - minX) + (size_t)sizeX * ((y - minY) + (size_t)sizeY * (z - minZ));
+                    uint64_t mask = (uint64_t)1 << (i & 63);
+                    nbCells += !(bits[i >> 6] & mask);
+                    bits[i >> 6] |= mask;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+vector<Cell3DPosition> CompactTarget::cells() const {
+    vector<Cell3DPosition> result;
+    result.reserve(nbCells);
+    for (unsigned z = 0; z < sizeZ; z++) {
+        for (unsigned y = 0; y < sizeY; y++) {
+            for (unsigned x = 0; x < sizeX; x++) {
+                size_t i = x + (size_t)sizeX * (y + (size_t)sizeY * z);
+                if (bits[i >> 6] >> (i & 63) & 1) result.push_back(Cell3DPosition(minX + x, minY + y, minZ + z));
+            }
+        }
+    }
+    return result;
+}
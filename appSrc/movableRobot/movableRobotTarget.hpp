@@ -0,0 +1,50 @@
+#ifndef MovableRobotTarget_H_
+#define MovableRobotTarget_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "grid/cell3DPosition.h"
+#include "deps/TinyXML/tinyxml.h"
+
+/**
+ * @brief Grid target stored as one bit per cell of its bounding box.
+ *  It is loaded once from the configuration file and shared by all the block codes,
+ *  a lookup is a bounds check and a bit test without branches.
+ *
+ * Besides the usual <cell position="x,y,z"/> entries, a <target format="grid"> may list
+ *  boxes of cells with <rect from="x,y,z" to="x,y,z"/> (bounds included), e.g. one per row.
+ */
+class CompactTarget {
+    int minX=0, minY=0, minZ=0;
+    unsigned sizeX=0, sizeY=0, sizeZ=0;
+    size_t nbCells=0;
+    std::vector<uint64_t> bits = std::vector<uint64_t>(1,0);
+
+public:
+    /**
+     * @brief Reads the first target of the <targetList> of the configuration
+     * @param config configuration file
+     * @return true if a grid target has been found
+     */
+    bool load(TiXmlDocument *config);
+
+    inline bool isInTarget(const Cell3DPosition &p) const {
+        unsigned x = p[0]-minX, y = p[1]-minY, z = p[2]-minZ;
+        size_t in = (x < sizeX) & (y < sizeY) & (z < sizeZ);
+        // out of the box the index is forced to 0, whose word always exists
+        size_t i = (x + (size_t)sizeX*(y + (size_t)sizeY*z)) & (0-in);
+        return in & (bits[i>>6] >> (i&63));
+    }
+
+    /// number of cells of the target
+    size_t size() const { return nbCells; }
+
+    /// cells of the target, in x then y then z order
+    std::vector<Cell3DPosition> cells() const;
+
+    /// memory used by the bitset in bytes
+    size_t memory() const { return bits.size()*sizeof(uint64_t); }
+};
+
+#endif /* MovableRobotTarget_H_ */
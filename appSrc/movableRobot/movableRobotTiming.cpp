@@ -0,0 +1,76 @@
+/**
+ * @file   movableRobotTiming.cpp
+ * @brief  Message latency and motion delay model of the movableRobot block code
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "movableRobotTiming.hpp"
+
+using namespace std;
+
+void TimingModel::load(TiXmlDocument *config) {
+    TiXmlNode *node = config->FirstChild("world");
+    if (node) node = node->FirstChild("timing");
+    TiXmlElement *element = node ? node->ToElement() : nullptr;
+    if (!element) return;
+
+    const char *attr;
+    if (!(fromCommandLine & MESSAGE_DELAY) && (attr = element->Attribute("messageDelay"))) {
+        messageDelay = strtoull(attr,nullptr,10);
+    }
+    if (!(fromCommandLine & MESSAGE_JITTER) && (attr = element->Attribute("messageJitter"))) {
+        messageJitter = strtoull(attr,nullptr,10);
+    }
+    if (!(fromCommandLine & JITTER) && (attr = element->Attribute("jitter"))) {
+        if (!parseJitter(attr,jitter)) cerr << "unknown jitter distribution " << attr << ", uniform is used" << endl;
+    }
+    if (!(fromCommandLine & MOTION_DELAY) && (attr = element->Attribute("motionDelay"))) {
+        motionDelay = strtoull(attr,nullptr,10);
+    }
+    if (!(fromCommandLine & SEED) && (attr = element->Attribute("seed"))) {
+        seed(strtoul(attr,nullptr,10));
+    }
+}
+
+bool TimingModel::parseJitter(const string &name, Jitter &j) {
+    if (name=="none") j = NONE;
+    else if (name=="uniform") j = UNIFORM;
+    else if (name=="normal") j = NORMAL;
+    else if (name=="exponential") j = EXPONENTIAL;
+    else return false;
+    return true;
+}
+
+const char *TimingModel::jitterName(Jitter j) {
+    switch (j) {
+        case NONE: return "none";
+        case UNIFORM: return "uniform";
+        case NORMAL: return "normal";
+        case EXPONENTIAL: return "exponential";
+    }
+    return "unknown";
+}
+
+uint64_t TimingModel::drawDelay() {
+    if (fastForward) return 0;
+    switch (jitter) {
+        case NORMAL: {
+            normal_distribution<double> d((double)messageDelay,(double)messageJitter);
+            return (uint64_t)max(0.0,round(d(rng)));
+        }
+        case EXPONENTIAL: {
+            if (messageJitter==0) return messageDelay;
+            exponential_distribution<double> d(1.0/messageJitter);
+            return messageDelay+(uint64_t)round(d(rng));
+        }
+        case UNIFORM: {
+            // drawn by the simulator (coreJitter), unless the sender orders its messages itself
+            uniform_int_distribution<uint64_t> d(0,messageJitter);
+            return messageDelay+d(rng);
+        }
+        default: return messageDelay;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef MovableRobotTiming_H_
+#define MovableRobotTiming_H_
+
+#include <cstdint>
+#include <random>
+#include <string>
+
+#include "deps/TinyXML/tinyxml.h"
+
+/**
+ * @brief Timing model of the movableRobot block code: latency of the messages and its random
+ *  variation, and delay before each motion. Shared by all the modules.
+ *
+ * It is read from an optional <timing> element of the world, e.g.
+ *      <timing messageDelay="1000" messageJitter="100" jitter="uniform" motionDelay="100000" seed="1"/>
+ * and from the command line (--message-delay, --message-jitter, --jitter, --motion-delay,
+ * --timing-seed, --fast-forward), which overrides the configuration file.
+ */
+class TimingModel {
+public:
+    enum Jitter {
+        NONE,         // every message takes messageDelay
+        UNIFORM,      // messageDelay + [0,messageJitter], drawn by the simulator
+        NORMAL,       // mean messageDelay, standard deviation messageJitter
+        EXPONENTIAL   // messageDelay + exponential of mean messageJitter
+    };
+
+    uint64_t messageDelay = 1000;
+    uint64_t messageJitter = 100;
+    Jitter jitter = UNIFORM;
+    uint64_t motionDelay = 100000;
+    // all delays are 0: events of a step share their date and only the algorithmic cost remains
+    bool fastForward = false;
+
+    // fields given on the command line, kept when the configuration file is read
+    enum Field { MESSAGE_DELAY=1, MESSAGE_JITTER=2, JITTER=4, MOTION_DELAY=8, SEED=16 };
+    unsigned fromCommandLine = 0;
+
+    /// reads the <timing> element of the world, if any
+    void load(TiXmlDocument *config);
+
+    /// parses a distribution name (none, uniform, normal, exponential), false if unknown
+    static bool parseJitter(const std::string &name, Jitter &j);
+    static const char *jitterName(Jitter j);
+
+    void seed(uint32_t s) { rng.seed(s); }
+
+    /// true when the random variation is drawn by the simulator core (sendMessage dt)
+    bool coreJitter() const { return !fastForward && jitter==UNIFORM; }
+
+    /// fixed part of the latency given to the simulator
+    uint64_t baseDelay() const { return fastForward ? 0 : messageDelay; }
+
+    /// random part given to the simulator, 0 when the model draws the whole latency
+    uint64_t coreJitterRange() const { return coreJitter() ? messageJitter : 0; }
+
+    /// latency of one message drawn by the model, for the distributions the simulator does not draw
+    ///  (!coreJitter()) or when the block code orders its messages itself
+    uint64_t drawDelay();
+
+    uint64_t motionStartDelay() const { return fastForward ? 0 : motionDelay; }
+
+private:
+    std::mt19937 rng;
+};
+
+#endif /* MovableRobotTiming_H_ */
@@ -0,0 +1,94 @@
+/**
+ * @file   movableRobotTrace.cpp
+ * @brief  Per-thread trace buffers of the movableRobot block code
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "movableRobotTrace.hpp"
+
+using namespace std;
+
+namespace {
+FILE *traceFile = nullptr;
+mutex traceLock;  // file and list of the buffers
+}
+
+struct MovableRobotTrace::Buffer {
+    // fixed ring of CAPACITY records: head is the next record, tail the oldest one not written yet,
+    // both count records since the creation of the buffer
+    unique_ptr<TraceRecord[]> records;
+    uint64_t head = 0, tail = 0;
+
+    Buffer() : records(new TraceRecord[CAPACITY]) {
+        lock_guard<mutex> guard(traceLock);
+        buffers().push_back(this);
+    }
+
+    ~Buffer() {
+        lock_guard<mutex> guard(traceLock);
+        flush();
+        auto &all = buffers();
+        for (size_t i=0; i<all.size(); i++) {
+            if (all[i]==this) {
+                all[i] = all.back();
+                all.pop_back();
+                break;
+            }
+        }
+    }
+
+    // called with traceLock held, writes the pending records in order, in two parts when they wrap
+    void flush() {
+        size_t first = tail%CAPACITY, n = head-tail;
+        size_t part = min(n,CAPACITY-first);
+        if (traceFile && n) {
+            fwrite(records.get()+first,sizeof(TraceRecord),part,traceFile);
+            if (n>part) fwrite(records.get(),sizeof(TraceRecord),n-part,traceFile);
+        }
+        tail = head;
+    }
+
+    static vector<Buffer*> &buffers() {
+        static vector<Buffer*> all;
+        return all;
+    }
+};
+
+MovableRobotTrace::Buffer &MovableRobotTrace::buffer() {
+    thread_local Buffer b;
+    return b;
+}
+
+void MovableRobotTrace::append(const TraceRecord &r) {
+    Buffer &b = buffer();
+    b.records[b.head++%CAPACITY] = r;
+    if (b.head-b.tail==CAPACITY) {
+        lock_guard<mutex> guard(traceLock);
+        b.flush();
+    }
+}
+
+bool MovableRobotTrace::open(const string &file) {
+    lock_guard<mutex> guard(traceLock);
+    if (traceFile) fclose(traceFile);
+    traceFile = fopen(file.c_str(),"wb");
+    if (!traceFile) return false;
+    fwrite(TRACE_MAGIC,1,sizeof(TRACE_MAGIC),traceFile);
+    origin = chrono::steady_clock::now();
+    enabled = true;
+    return true;
+}
+
+void MovableRobotTrace::close() {
+    lock_guard<mutex> guard(traceLock);
+    enabled = false;
+    if (!traceFile) return;
+    for (Buffer *b : Buffer::buffers()) b->flush();
+    fclose(traceFile);
+    traceFile = nullptr;
+}
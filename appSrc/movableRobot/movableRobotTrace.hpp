@@ -0,0 +1,71 @@
+#ifndef MovableRobotTrace_H_
+#define MovableRobotTrace_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Event trace of the movableRobot block code (--trace <file>).
+ *  Records are appended to a ring buffer of the calling thread, which is written to the trace
+ *  file as raw records each time it is full and at the end of the run. When tracing is off,
+ *  a record costs a test of a static flag.
+ *
+ * File format: the 8 bytes magic "MRTRACE1", then TraceRecord structures (32 bytes, host
+ *  endianness). movableRobotTraceConv converts a trace into the Chrome trace JSON format.
+ */
+struct TraceRecord {
+    enum Kind : uint16_t {
+        SEND,          // a: destination interface (-1 for all neighbors), b: number of copies
+        RECEIVE,       // a: interface of the sender
+        ROUND,         // a: round, b: distance to the root
+        LEADER,        // a: round, module becomes the leader / mover
+        MOTION_START,  // a,b: destination cell, date is the start of the motion
+        MOTION_END,    // a,b: position of the module
+        NB_KINDS
+    };
+
+    uint64_t date;     // simulated time
+    uint64_t hostNs;   // host time since the beginning of the trace
+    uint32_t module;
+    uint16_t kind;
+    uint16_t msgType;  // message type for SEND/RECEIVE, 0 otherwise
+    int32_t a, b;
+};
+static_assert(sizeof(TraceRecord)==32, "trace records are written as raw 32 bytes structures");
+
+static const char TRACE_MAGIC[8] = {'M','R','T','R','A','C','E','1'};
+
+class MovableRobotTrace {
+    static const size_t CAPACITY = 1<<16;  // records of a thread buffer
+
+    struct Buffer;
+    static Buffer &buffer();
+    static void append(const TraceRecord &r);
+
+public:
+    inline static bool enabled = false;
+    inline static std::chrono::steady_clock::time_point origin;
+
+    /// opens the trace file and enables tracing, false if the file cannot be written
+    static bool open(const std::string &file);
+
+    /// writes the records left in the buffers of all threads and closes the file
+    static void close();
+
+    static void record(uint64_t date, uint32_t module, uint16_t kind, uint16_t msgType=0,
+                       int32_t a=0, int32_t b=0) {
+        if (!enabled) return;
+        TraceRecord r;
+        r.date = date;
+        r.hostNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-origin).count();
+        r.module = module;
+        r.kind = kind;
+        r.msgType = msgType;
+        r.a = a;
+        r.b = b;
+        append(r);
+    }
+};
+
+#endif /* MovableRobotTrace_H_ */
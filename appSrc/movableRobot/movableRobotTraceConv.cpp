@@ -0,0 +1,123 @@
+/**
+ * @file   movableRobotTraceConv.cpp
+ * @brief  Converter of movableRobot binary traces (--trace) to the Chrome trace JSON format
+ *
+ * Each module is a thread of the trace, messages, rounds and leader hand-offs are instant
+ * events and motions are duration events. Timestamps are the simulated dates, or the host
+ * time of the records with --host, to see where the simulator spends its CPU time.
+ * The output can be opened in chrome://tracing or https://ui.perfetto.dev
+ *
+ * usage: movableRobotTraceConv <trace file> [out.json] [--host]
+ **/
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "movableRobotMessages.hpp"
+#include "movableRobotTrace.hpp"
+
+using namespace std;
+
+static const char *kindName(uint16_t kind) {
+    static const char *names[TraceRecord::NB_KINDS] = {
+        "send", "receive", "round", "leader", "motion", "motion"
+    };
+    return kind < TraceRecord::NB_KINDS ? names[kind] : "unknown";
+}
+
+int main(int argc, char **argv) {
+    vector<string> files;
+    bool host = false;
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i],"--host")==0) host = true;
+        else files.push_back(argv[i]);
+    }
+    if (files.empty()) {
+        cerr << "usage: " << argv[0] << " <trace file> [out.json] [--host]" << endl;
+        return 1;
+    }
+
+    FILE *in = fopen(files[0].c_str(),"rb");
+    char magic[sizeof(TRACE_MAGIC)];
+    if (!in || fread(magic,1,sizeof(magic),in)!=sizeof(magic) || memcmp(magic,TRACE_MAGIC,sizeof(magic))!=0) {
+        cerr << files[0] << " is not a movableRobot trace" << endl;
+        return 1;
+    }
+
+    ofstream file;
+    if (files.size()>1) {
+        file.open(files[1]);
+        if (!file) {
+            cerr << "cannot write " << files[1] << endl;
+            return 1;
+        }
+    }
+    ostream &out = files.size()>1 ? file : cout;
+
+    // ts are in microseconds, the unit of the simulated dates
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\""
+        << (host ? "movableRobot (host time)" : "movableRobot (simulated time)") << "\"}}";
+
+    // a motion is drawn from its start to its end, the start is recorded when it is scheduled
+    map<uint32_t,TraceRecord> motionStart;
+    map<uint32_t,bool> modules;
+    TraceRecord r;
+    size_t nbRecords = 0;
+    while (fread(&r,sizeof(r),1,in)==1) {
+        nbRecords++;
+        double ts = host ? r.hostNs/1000.0 : (double)r.date;
+        if (!modules[r.module]) {
+            modules[r.module] = true;
+            out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << r.module
+                << ",\"args\":{\"name\":\"module " << r.module << "\"}}";
+        }
+
+        if (r.kind==TraceRecord::MOTION_START) {
+            motionStart[r.module] = r;
+            continue;
+        }
+        if (r.kind==TraceRecord::MOTION_END) {
+            auto it = motionStart.find(r.module);
+            if (it!=motionStart.end()) {
+                const TraceRecord &s = it->second;
+                double start = host ? s.hostNs/1000.0 : (double)s.date;
+                out << ",\n{\"name\":\"motion\",\"cat\":\"motion\",\"ph\":\"X\",\"pid\":1,\"tid\":" << r.module
+                    << ",\"ts\":" << start << ",\"dur\":" << ts-start
+                    << ",\"args\":{\"to\":\"" << s.a << "," << s.b << "\"}}";
+                motionStart.erase(it);
+            }
+            continue;
+        }
+
+        out << ",\n{\"name\":\"" << kindName(r.kind);
+        if (r.kind==TraceRecord::SEND || r.kind==TraceRecord::RECEIVE) out << " " << messageTypeName(r.msgType);
+        out << "\",\"cat\":\"" << (r.kind<=TraceRecord::RECEIVE ? "message" : "election")
+            << "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << r.module << ",\"ts\":" << ts << ",\"args\":{";
+        switch (r.kind) {
+            case TraceRecord::SEND:
+                out << "\"interface\":" << r.a << ",\"copies\":" << r.b;
+                break;
+            case TraceRecord::RECEIVE:
+                out << "\"interface\":" << r.a;
+                break;
+            case TraceRecord::ROUND:
+                out << "\"round\":" << r.a << ",\"distance\":" << r.b;
+                break;
+            case TraceRecord::LEADER:
+                out << "\"round\":" << r.a;
+                break;
+        }
+        out << "}}";
+    }
+    fclose(in);
+    out << "\n]}\n";
+
+    cerr << nbRecords << " records of " << modules.size() << " modules" << endl;
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef MovableRobotWalk_H_
+#define MovableRobotWalk_H_
+
+#include <cstdint>
+
+#include "grid/cell3DPosition.h"
+#include "robots/hexanodes/hexanodesMotionEngine.h"
+
+/**
+ * @brief Rule of the walk motion cache of the block code (walkMotion), shared with the
+ *  microbenchmarks (movableRobotMicroBench.cpp).
+ *
+ * The motion the simulator gave for a module stays the next step of its walk while the module
+ *  keeps its cell, its orientation and its walk direction, and no neighbor is added or removed
+ *  (valid is reset by the neighbor events).
+ */
+inline bool walkCacheHit(bool valid, const Cell3DPosition &cachedPosition, uint8_t cachedOrientation,
+                         Hexanodes::motionDirection cachedDirection, const Cell3DPosition &position,
+                         uint8_t orientation, Hexanodes::motionDirection direction) {
+    return valid && cachedPosition==position && cachedOrientation==orientation && cachedDirection==direction;
+}
+
+#endif /* MovableRobotWalk_H_ */
@@ -0,0 +1,316 @@
+/**
+ * @file   movableRobotWorldGen.cpp
+ * @brief  Generator of synthetic VisibleSim worlds for the movableRobot block code
+ *
+ * Writes a hexanodes world with N modules in a parameterized initial shape, a leader and
+ * a matching target of N cells (a flat rectangle next to the initial shape, like in
+ * cylinder2block.xml), so that the election and motion logic can be measured versus size.
+ *
+ * usage: movableRobotWorldGen --shape rect|L|cylinder|blob --modules N [--seed S] [--out file.xml] [--compact]
+ *
+ * With --compact, the modules of each row are written as a single <blocksLine> of the blockList
+ * (values is a string of 0/1 from x=0) and the leader as the only <block> element, so that a
+ * world of 100k modules is a few hundred elements to parse instead of one per module, and the target
+ * is written as boxes of cells (<rect>), which only the block code reads. Up to CELL_TARGET_MAX
+ * modules the target is also written cell by cell, so that the simulator loads it too; above it,
+ * only the movableRobot block code sees a target.
+ * Without --compact the target is only written cell by cell.
+ **/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+typedef pair<int,int> Cell; // (x,y)
+
+static const int MARGIN = 2;
+// largest compact world whose target is also written cell by cell for the simulator
+static const int CELL_TARGET_MAX = 10000;
+
+// rows of w cells, bottom-up, the last row is partial
+static vector<Cell> rectShape(int n) {
+    int w = max(1,(int)ceil(sqrt((double)n)));
+    vector<Cell> cells;
+    for (int i=0; i<n; i++) cells.push_back(Cell(i%w,i/w));
+    return cells;
+}
+
+// horizontal foot of t rows, then a vertical arm of t columns on its left side
+static vector<Cell> lShape(int n) {
+    int t = max(2,(int)sqrt((double)n)/3);
+    int w = max(t+1,(int)ceil(sqrt((double)n)));
+    vector<Cell> cells;
+    for (int y=0; y<t && (int)cells.size()<n; y++) {
+        for (int x=0; x<w && (int)cells.size()<n; x++) cells.push_back(Cell(x,y));
+    }
+    for (int y=t; (int)cells.size()<n; y++) {
+        for (int x=0; x<t && (int)cells.size()<n; x++) cells.push_back(Cell(x,y));
+    }
+    return cells;
+}
+
+// center of a cell of the hexagonal lattice, odd rows are shifted by half a cell
+static pair<double,double> cellCenter(const Cell &c) {
+    return make_pair(c.first+((c.second&1)?0.5:0.0), c.second*sqrt(3.0)/2.0);
+}
+
+// ring of outer radius R and inner radius R/2, the outermost cells are dropped to keep n
+static vector<Cell> cylinderShape(int n) {
+    double R = sqrt(n/(0.75*M_PI));
+    vector<pair<double,Cell>> ring;
+    while ((int)ring.size()<n) {
+        ring.clear();
+        int r = (int)ceil(R)+1;
+        pair<double,double> o = cellCenter(Cell(r,r));
+        for (int y=0; y<=2*r; y++) {
+            for (int x=0; x<=2*r; x++) {
+                pair<double,double> p = cellCenter(Cell(x,y));
+                double d = hypot(p.first-o.first,p.second-o.second);
+                if (d<=R && d>=R/2) ring.push_back(make_pair(d,Cell(x,y)));
+            }
+        }
+        R += 0.5;
+    }
+    sort(ring.begin(),ring.end());
+    vector<Cell> cells;
+    for (int i=0; i<n; i++) cells.push_back(ring[i].second);
+    return cells;
+}
+
+// the six neighbors of a cell around it (E, NE, NW, W, SW, SE), consecutive ones are neighbors too
+static void hexNeighbors(const Cell &c, Cell nb[6]) {
+    int s = c.second&1;
+    nb[0] = Cell(c.first+1,c.second);
+    nb[1] = Cell(c.first+s,c.second+1);
+    nb[2] = Cell(c.first+s-1,c.second+1);
+    nb[3] = Cell(c.first-1,c.second);
+    nb[4] = Cell(c.first+s-1,c.second-1);
+    nb[5] = Cell(c.first+s,c.second-1);
+}
+
+// fills the empty cells that cannot be reached from outside the bounding box
+static void fillHoles(set<Cell> &cells) {
+    int minX = cells.begin()->first, maxX = minX, minY = cells.begin()->second, maxY = minY;
+    for (const Cell &c : cells) {
+        minX = min(minX,c.first);
+        maxX = max(maxX,c.first);
+        minY = min(minY,c.second);
+        maxY = max(maxY,c.second);
+    }
+    minX--; maxX++; minY--; maxY++;
+    set<Cell> outside;
+    vector<Cell> stack(1,Cell(minX,minY));
+    outside.insert(stack[0]);
+    Cell nb[6];
+    while (!stack.empty()) {
+        Cell c = stack.back();
+        stack.pop_back();
+        hexNeighbors(c,nb);
+        for (const Cell &d : nb) {
+            if (d.first<minX || d.first>maxX || d.second<minY || d.second>maxY) continue;
+            if (!cells.count(d) && outside.insert(d).second) stack.push_back(d);
+        }
+    }
+    for (int y=minY; y<=maxY; y++) {
+        for (int x=minX; x<=maxX; x++) {
+            if (!outside.count(Cell(x,y))) cells.insert(Cell(x,y));
+        }
+    }
+}
+
+// a cell whose occupied neighbors form one arc can leave a shape without hole: the others stay
+// connected through the arc and the freed cell touches the outside through the empty arc
+static bool removable(const set<Cell> &cells, const Cell &c) {
+    Cell nb[6];
+    hexNeighbors(c,nb);
+    int changes = 0;
+    for (int k=0; k<6; k++) changes += cells.count(nb[k])!=cells.count(nb[(k+1)%6]);
+    return changes==2;
+}
+
+// random growth from one cell, through E/W/N/S neighbors which are connected for both row parities;
+// the holes enclosed by the growth are filled, then border cells are removed to get back to n
+static vector<Cell> blobShape(int n, mt19937 &rng) {
+    set<Cell> cells;
+    for (;;) {
+        cells.clear();
+        vector<Cell> frontier;
+        Cell seed(0,0);
+        cells.insert(seed);
+        frontier.push_back(seed);
+        const int dx[4] = {1,-1,0,0}, dy[4] = {0,0,1,-1};
+        while ((int)cells.size()<n) {
+            size_t i = rng()%frontier.size();
+            Cell c = frontier[i];
+            int d = rng()%4;
+            Cell nc(c.first+dx[d],c.second+dy[d]);
+            if (cells.insert(nc).second) frontier.push_back(nc);
+
+            // cells surrounded on the four sides can no longer grow
+            int free = 0;
+            for (int k=0; k<4; k++) free += !cells.count(Cell(c.first+dx[k],c.second+dy[k]));
+            if (free==0) {
+                frontier[i] = frontier.back();
+                frontier.pop_back();
+            }
+        }
+
+        fillHoles(cells);
+        bool removed = true;
+        while ((int)cells.size()>n && removed) {
+            removed = false;
+            for (auto it=cells.begin(); it!=cells.end() && (int)cells.size()>n; ) {
+                if (removable(cells,*it)) {
+                    it = cells.erase(it);
+                    removed = true;
+                } else ++it;
+            }
+        }
+        // no border cell could be removed, grow another blob
+        if ((int)cells.size()==n) break;
+    }
+    return vector<Cell>(cells.begin(),cells.end());
+}
+
+int main(int argc, char **argv) {
+    string shape = "rect", out;
+    int n = 100;
+    unsigned seed = 1;
+    bool compact = false;
+
+    for (int i=1; i<argc; i++) {
+        string arg = argv[i];
+        if (i+1<argc && arg=="--shape") shape = argv[++i];
+        else if (i+1<argc && arg=="--modules") n = atoi(argv[++i]);
+        else if (i+1<argc && arg=="--seed") seed = atoi(argv[++i]);
+        else if (i+1<argc && arg=="--out") out = argv[++i];
+        else if (arg=="--compact") compact = true;
+        else {
+            cerr << "usage: " << argv[0] << " --shape rect|L|cylinder|blob --modules N [--seed S] [--out file.xml] [--compact]" << endl;
+            return 1;
+        }
+    }
+    if (n<2) {
+        cerr << "at least 2 modules are needed" << endl;
+        return 1;
+    }
+
+    mt19937 rng(seed);
+    vector<Cell> cells;
+    if (shape=="rect") cells = rectShape(n);
+    else if (shape=="L") cells = lShape(n);
+    else if (shape=="cylinder") cells = cylinderShape(n);
+    else if (shape=="blob") cells = blobShape(n,rng);
+    else {
+        cerr << "unknown shape " << shape << endl;
+        return 1;
+    }
+
+    // move the shape to the lattice origin plus a margin, keeping the parity of the rows
+    int minX = cells[0].first, minY = cells[0].second;
+    for (const Cell &c : cells) {
+        minX = min(minX,c.first);
+        minY = min(minY,c.second);
+    }
+    int offX = MARGIN-minX, offY = MARGIN-minY;
+    if (offY&1) offY++;
+    for (Cell &c : cells) {
+        c.first += offX;
+        c.second += offY;
+    }
+    sort(cells.begin(),cells.end(),[](const Cell &a, const Cell &b) {
+        return a.second<b.second || (a.second==b.second && a.first<b.first);
+    });
+
+    // the leader is the rightmost module of the bottom row, the target is placed on the right
+    // of the rows it covers so that it touches the initial shape without overlapping it
+    int baseY = cells[0].second, leader = 0;
+    for (int i=0; i<(int)cells.size() && cells[i].second==baseY; i++) leader = i;
+    int th = max(2,(int)round(sqrt((double)n)/2));
+    int tw = (n+th-1)/th;
+    int targetX = 0;
+    for (const Cell &c : cells) {
+        if (c.second<baseY+th) targetX = max(targetX,c.first+1);
+    }
+
+    int gx = targetX+tw, gy = 0;
+    for (const Cell &c : cells) {
+        gx = max(gx,c.first+1);
+        gy = max(gy,c.second+1);
+    }
+    gx += MARGIN;
+    gy = max(gy,baseY+th)+MARGIN;
+
+    ofstream file;
+    if (!out.empty()) {
+        file.open(out);
+        if (!file) {
+            cerr << "cannot write " << out << endl;
+            return 1;
+        }
+    }
+    ostream &os = out.empty() ? cout : file;
+
+    os << "<?xml version=\"1.0\" standalone=\"no\" ?>\n"
+       << "<visuals windowSize=\"1475,610\"/>\n"
+       << "<world gridSize=\"" << gx << "," << gy << ",1\" >\n"
+       << "<camera target=\"" << gx*20 << "," << gy*20 << ",0\" directionSpherical=\"0,65,"
+       << max(gx,gy)*45 << "\" angle=\"35\" near=\"88\" far=\"" << max(gx,gy)*200 << "\" />\n"
+       << "<spotlight target=\"" << gx*20 << "," << gy*20 << ",3\" directionSpherical=\"60,30,"
+       << max(gx,gy)*45 << "\" angle=\"33\" />\n"
+       << "<blockList color=\"128,128,128\">\n";
+    if (compact) {
+        // the attributes of a blocksLine apply to all its modules, the leader has its own element
+        os << "    <block position=\"" << cells[leader].first << "," << cells[leader].second
+           << ",0\" leader=\"true\" color=\"255,255,0\"/>\n";
+        for (size_t i=0; i<cells.size(); ) {
+            int y = cells[i].second;
+            string values;
+            for (; i<cells.size() && cells[i].second==y; i++) {
+                if ((int)i==leader) continue;
+                values.resize(cells[i].first,'0');
+                values += '1';
+            }
+            if (!values.empty()) os << "    <blocksLine line=\"" << y << "\" plane=\"0\" values=\"" << values << "\"/>\n";
+        }
+    } else {
+        for (int i=0; i<(int)cells.size(); i++) {
+            os << "    <block position=\"" << cells[i].first << "," << cells[i].second << ",0\"";
+            if (i==leader) os << " leader=\"true\" color=\"255,255,0\"";
+            os << "/>\n";
+        }
+    }
+    os << "</blockList>\n\n"
+       << "<targetList>\n"
+       << "    <target format=\"grid\">\n";
+    // full rows as one box, the partial last row as another one
+    int fullRows = n/tw, lastRow = n%tw;
+    if (compact) {
+        os << "        <rect from=\"" << targetX << "," << baseY << ",0\" to=\""
+           << targetX+tw-1 << "," << baseY+fullRows-1 << ",0\"/>\n";
+        if (lastRow) {
+            os << "        <rect from=\"" << targetX << "," << baseY+fullRows << ",0\" to=\""
+               << targetX+lastRow-1 << "," << baseY+fullRows << ",0\"/>\n";
+        }
+    }
+    // the block code counts a cell listed both in a box and alone once
+    if (!compact || n<=CELL_TARGET_MAX) {
+        for (int i=0; i<n; i++) {
+            os << "        <cell position=\"" << targetX+i%tw << "," << baseY+i/tw << ",0\"/>\n";
+        }
+    }
+    os << "    </target>\n"
+       << "</targetList>\n"
+       << "</world>\n";
+
+    return 0;
+}
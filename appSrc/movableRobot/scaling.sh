@@ -0,0 +1,47 @@
+#!/bin/bash
+#
+# Size sweep of the movableRobot block code.
+# Generates worlds of growing size with movableRobotWorldGen, runs each one headless and
+# appends one JSON report per size, to plot messages and motions versus the number of modules.
+#
+# usage: scaling.sh <movableRobot binary> <movableRobotWorldGen binary> <shape> <report file> N1 [N2 ...]
+#   shape is rect, L, cylinder or blob
+#   VSIM_FLAGS overrides the simulator flags, BLOCK_OPTIONS adds block code options (e.g. --incremental)
+#   GEN_OPTIONS overrides the generator options (default: --compact, one <blocksLine> per row)
+#   with --compact the target of a world above 10000 modules is only written as <rect> boxes, which
+#   the simulator does not load: only the movableRobot block code sees it, use GEN_OPTIONS="" to
+#   have it loaded by the simulator at any size
+
+if [ $# -lt 5 ]; then
+    echo "usage: $0 <movableRobot binary> <movableRobotWorldGen binary> <shape> <report file> N1 [N2 ...]"
+    exit 1
+fi
+
+EXEC=$(realpath "$1")
+GEN=$(realpath "$2")
+SHAPE=$3
+REPORT=$(realpath -m "$4")
+shift 4
+FLAGS=${VSIM_FLAGS:-"-t -R -x"}
+GEN_OPTIONS=${GEN_OPTIONS-"--compact"}
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+status=0
+for n in "$@"; do
+    world="$WORK/${SHAPE}_$n.xml"
+    "$GEN" --shape "$SHAPE" --modules "$n" --out "$world" $GEN_OPTIONS || exit 1
+    printf "%-16s" "${SHAPE}_$n"
+    if (cd "$WORK" && "$EXEC" -c "$world" $FLAGS --report "$REPORT" $BLOCK_OPTIONS > /dev/null 2>&1); then
+        # loading of the world apart from the reconfiguration
+        line=$(tail -n 1 "$REPORT")
+        startup=$(echo "$line" | grep -o '"startupMs":[^,}]*' | cut -d: -f2)
+        printf "startup %10s ms  %s\n" "$startup" "$line"
+    else
+        echo "FAILED"
+        status=1
+    fi
+done
+
+exit $status